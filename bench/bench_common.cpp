@@ -0,0 +1,43 @@
+﻿#include "bench_common.h"
+#include <benchmark/benchmark.h>    // benchmark::Initialize()
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector<>
+
+namespace bux {
+
+//
+//      Functions
+//
+bool initBenchmarks(int argc, char **argv, const char *defaultOut)
+/*! \brief Initialize Google Benchmark by command line arguments, writing results to \a defaultOut in JSON
+    unless <tt>--benchmark_out=</tt> is given, so that results can be compared across versions and builds.
+    Build type, compiler flags, LTO and PGO of the build are recorded in the context of results.
+    \return false if there are unrecognized arguments
+*/
+{
+    std::vector<char*> args(argv, argv + argc);
+    bool hasOut = false;
+    for (int i = 1; i < argc; ++i)
+        if (std::string_view{argv[i]}.starts_with("--benchmark_out="))
+            hasOut = true;
+
+    static std::string outArg, formatArg = "--benchmark_out_format=json";
+    if (!hasOut)
+    {
+        outArg = std::string{"--benchmark_out="} + defaultOut;
+        args.emplace_back(outArg.data());
+        args.emplace_back(formatArg.data());
+    }
+    auto n = static_cast<int>(args.size());
+    benchmark::Initialize(&n, args.data());
+#ifdef BUX_MY_BUILD_TYPE
+    benchmark::AddCustomContext("build_type", BUX_MY_BUILD_TYPE);
+    benchmark::AddCustomContext("cxx_flags", BUX_MY_CXX_FLAGS);
+    benchmark::AddCustomContext("lto", BUX_MY_LTO);
+    benchmark::AddCustomContext("pgo", *BUX_MY_PGO? BUX_MY_PGO: "OFF");
+#endif
+    return !benchmark::ReportUnrecognizedArguments(n, args.data());
+}
+
+} // namespace bux
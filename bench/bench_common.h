@@ -0,0 +1,14 @@
+﻿#pragma once
+
+/*! \file
+    \brief Common setup of benchmark executables
+*/
+
+namespace bux {
+
+//
+//      Externs
+//
+bool initBenchmarks(int argc, char **argv, const char *defaultOut);
+
+} // namespace bux
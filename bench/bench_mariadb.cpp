@@ -0,0 +1,276 @@
+﻿#include "bench_common.h"
+#include "local_mariadbd.h"
+#include "../tools/latency_proxy.h"
+#include <bux/oo_mariadb.h> // bux::C_MySQL, bux::C_MySqlStmt, bux::query(), bux::queryString()
+#include <benchmark/benchmark.h>    // BENCHMARK(), benchmark::State
+#include <cstdlib>          // getenv(), strtoul()
+#include <iostream>         // std::cerr
+#include <map>              // std::map<>
+#include <memory>           // std::unique_ptr<>
+#include <string>           // std::string, std::to_string()
+#include <vector>           // std::vector<>
+
+namespace {
+
+//
+//      In-Module Constants
+//
+constexpr unsigned KV_ROWS      = 10000;
+constexpr unsigned SCAN_ROWS    = 100000;
+constexpr unsigned BLOB_SIZES[] = {1 << 10, 64 << 10, 1 << 20, 16 << 20};
+constexpr long RTT_US[]         = {100, 1000, 10000};
+
+//
+//      In-Module Data
+//
+bux::C_MyConnectArg g_connArg;
+std::map<long,unsigned> g_proxyPorts;  // by RTT in microseconds
+
+//
+//      In-Module Functions
+//
+void populate(bux::C_MySQL &mysql)
+{
+    bux::query(mysql, "create database bench");
+    bux::useDatabase(mysql, "bench");
+    bux::query(mysql, "create table kv(id int unsigned primary key, v varchar(64) not null)");
+    bux::query(mysql, "insert into kv select seq, sha2(seq, 256) from seq_1_to_" + std::to_string(KV_ROWS));
+    bux::query(mysql, "create table ins(id bigint unsigned auto_increment primary key, a int not null, b varchar(64) not null)");
+    bux::query(mysql, "create table blobs(id int unsigned primary key, b longblob not null)");
+    for (auto i: BLOB_SIZES)
+        bux::query(mysql, "insert into blobs values(" + std::to_string(i) + ",repeat('x'," + std::to_string(i) + "))");
+    bux::query(mysql, "create table scan(id int unsigned primary key, v varchar(64) not null)");
+    bux::query(mysql, "insert into scan select seq, sha2(seq, 256) from seq_1_to_" + std::to_string(SCAN_ROWS));
+}
+
+bux::C_MySQL connect(long rttUs = 0)
+/*! \param [in] rttUs Nonzero to connect through the latency proxy of the RTT
+    \return Connection of its own for each benchmark
+*/
+{
+    auto arg = g_connArg;
+    arg.m_db = "bench";
+    if (rttUs)
+        arg.m_port = g_proxyPorts.at(rttUs);
+
+    return bux::C_MySQL{arg};
+}
+
+} // namespace
+
+//
+//      Benchmarks
+//
+static void BM_PointSelectQueryString(benchmark::State &state)
+{
+    auto mysql = connect();
+    unsigned id = 0;
+    for (auto _: state)
+        benchmark::DoNotOptimize(bux::queryString(mysql, "select v from kv where id=" + std::to_string(id++ % KV_ROWS + 1)));
+}
+BENCHMARK(BM_PointSelectQueryString);
+
+static void BM_PointSelectStmt(benchmark::State &state)
+{
+    auto mysql = connect();
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    stmt.prepare("select v from kv where id=?");
+    unsigned id = 0;
+    stmt.bindParams([&](MYSQL_BIND *barr){
+        bux::bindInt(barr[0], id);
+    });
+    char v[65];
+    for (unsigned i = 0; auto _: state)
+    {
+        id = i++ % KV_ROWS + 1;
+        stmt.execBindResults([&](MYSQL_BIND *barr){
+            bux::bindStrBuffer(barr[0], v, sizeof v);
+        });
+        while (stmt.nextRow())
+            benchmark::DoNotOptimize(v);
+    }
+}
+BENCHMARK(BM_PointSelectStmt);
+
+static void BM_InsertSingle(benchmark::State &state)
+{
+    auto mysql = connect();
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    stmt.prepare("insert into ins(a,b) values(?,?)");
+    int a = 0;
+    const std::string b(32, 'b');
+    stmt.bindParams([&](MYSQL_BIND *barr){
+        bux::bindInt(barr[0], a);
+        bux::bindStrParam(barr[1], b);
+    });
+    for (auto _: state)
+    {
+        ++a;
+        stmt.exec();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InsertSingle);
+
+static void BM_InsertBatched(benchmark::State &state)
+{
+    const auto rows = static_cast<size_t>(state.range(0));
+    auto mysql = connect();
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    std::string sql = "insert into ins(a,b) values(?,?)";
+    for (size_t i = 1; i < rows; ++i)
+        sql += ",(?,?)";
+    stmt.prepare(sql);
+
+    std::vector<int> a(rows);
+    const std::string b(32, 'b');
+    stmt.bindParams([&](MYSQL_BIND *barr){
+        for (size_t i = 0; i < rows; ++i)
+        {
+            bux::bindInt(barr[2*i], a[i]);
+            bux::bindStrParam(barr[2*i+1], b);
+        }
+    });
+    for (auto _: state)
+    {
+        for (auto &i: a)
+            ++i;
+        stmt.exec();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_InsertBatched)->RangeMultiplier(10)->Range(10, 1000);
+
+static void BM_GetLongBlob(benchmark::State &state)
+{
+    auto mysql = connect();
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    stmt.prepare("select b from blobs where id=?");
+    auto id = static_cast<unsigned>(state.range(0));
+    stmt.bindParams([&](MYSQL_BIND *barr){
+        bux::bindInt(barr[0], id);
+    });
+    for (auto _: state)
+    {
+        stmt.execBindResults([](MYSQL_BIND *barr){
+            bux::bindLongBlob(barr[0]);
+        });
+        if (!stmt.nextRow())
+        {
+            state.SkipWithError("Blob not found");
+            break;
+        }
+        benchmark::DoNotOptimize(stmt.getLongBlob(0));
+        while (stmt.nextRow());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetLongBlob)->Apply([](auto *b){
+    for (auto i: BLOB_SIZES)
+        b->Arg(i);
+});
+
+static void BM_Scan(benchmark::State &state)
+{
+    auto mysql = connect();
+    const auto kind = static_cast<bux::E_MySqlResultKind>(state.range(0));
+    const auto sql = "select id,v from scan limit " + std::to_string(state.range(1));
+    for (auto _: state)
+    {
+        const auto res = bux::query(mysql, sql, kind);
+        while (const auto row = mysql_fetch_row(res))
+            benchmark::DoNotOptimize(row);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_Scan)
+    ->ArgsProduct({{bux::MYSQL_USE_RESULT, bux::MYSQL_STORE_RESULT}, {1000, SCAN_ROWS}})
+    ->ArgNames({"kind", "rows"})
+    ->Unit(benchmark::kMillisecond);
+
+//
+//      Benchmarks through Latency Proxies
+//
+static void BM_RttPointSelect(benchmark::State &state)
+{
+    auto mysql = connect(state.range(0));
+    MYSQL *const raw = mysql.mysql();
+    const auto before = mysql.roundTrips();
+    for (unsigned id = 0; auto _: state)
+    {
+        const auto sql = "select v from kv where id=" + std::to_string(id++ % KV_ROWS + 1);
+        // C_MySQL pings before every use
+        benchmark::DoNotOptimize(state.range(1)? bux::queryString(mysql, sql): bux::queryString(raw, sql));
+    }
+    state.counters["round_trips"] = benchmark::Counter(double(mysql.roundTrips() - before), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_RttPointSelect)
+    ->ArgsProduct({{std::begin(RTT_US), std::end(RTT_US)}, {0, 1}})
+    ->ArgNames({"rtt_us", "ping"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+static void BM_RttInsert100(benchmark::State &state)
+{
+    const auto batch = static_cast<size_t>(state.range(1));
+    auto mysql = connect(state.range(0));
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    std::string sql = "insert into ins(a,b) values(?,?)";
+    for (size_t i = 1; i < batch; ++i)
+        sql += ",(?,?)";
+    stmt.prepare(sql);
+
+    std::vector<int> a(batch);
+    const std::string b(32, 'b');
+    stmt.bindParams([&](MYSQL_BIND *barr){
+        for (size_t i = 0; i < batch; ++i)
+        {
+            bux::bindInt(barr[2*i], a[i]);
+            bux::bindStrParam(barr[2*i+1], b);
+        }
+    });
+    const auto before = mysql.roundTrips();
+    for (auto _: state)
+        for (size_t i = 0; i < 100; i += batch)
+            stmt.exec();
+
+    state.SetItemsProcessed(state.iterations() * 100);
+    state.counters["round_trips"] = benchmark::Counter(double(mysql.roundTrips() - before), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_RttInsert100)
+    ->ArgsProduct({{std::begin(RTT_US), std::end(RTT_US)}, {1, 10, 100}})
+    ->ArgNames({"rtt_us", "batch"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+int main(int argc, char **argv)
+{
+    if (!bux::initBenchmarks(argc, argv, "bux-mariadb-bench.json"))
+        return 1;
+
+    try
+    {
+        const auto port = getenv("BUX_MY_BENCH_PORT");
+        bux::C_LocalMariadbd server{port? static_cast<unsigned>(strtoul(port, nullptr, 10)): 33061};
+        g_connArg = server.connectArg();
+        std::vector<std::unique_ptr<bux::C_LatencyProxy>> proxies;
+        for (auto i: RTT_US)
+        {
+            auto &proxy = *proxies.emplace_back(std::make_unique<bux::C_LatencyProxy>(
+                g_connArg.m_host, *g_connArg.m_port, 0, bux::C_LatencyProxy::C_Options{std::chrono::microseconds(i)}));
+            g_proxyPorts[i] = proxy.port();
+        }
+        {
+            bux::C_MySQL mysql{g_connArg};
+            populate(mysql);
+            benchmark::AddCustomContext("mariadbd", bux::queryString(mysql, "select version()"));
+        }
+        benchmark::RunSpecifiedBenchmarks();
+        benchmark::Shutdown();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr <<e.what() <<'\n';
+        return 1;
+    }
+}
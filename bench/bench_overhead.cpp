@@ -0,0 +1,215 @@
+﻿#include "bench_common.h"
+#include "fake_connector.h"
+#include <bux/oo_mariadb.h> // bux::C_MySQL, bux::C_MySqlStmt, bux::queryRows(), bux::queryString()
+#include <bux/oo_mariadb_observe.h> // bux::I_MyObserver, bux::addObserver()
+#include <benchmark/benchmark.h>    // BENCHMARK(), benchmark::State
+#include <string>           // std::string, std::to_string()
+#include <utility>          // std::pair<>
+#include <vector>           // std::vector<>
+
+namespace {
+
+//
+//      In-Module Types
+//
+class C_NullObserver: public bux::I_MyObserver
+{
+    // Implement I_MyObserver
+    void onOp(const bux::C_MyOpEvent&) noexcept override {}
+};
+
+//
+//      In-Module Data
+//
+const bux::C_FakeReply  g_ok;
+std::vector<std::pair<std::string,bux::C_FakeReply>> g_replies; // by SQL prefix
+C_NullObserver          g_nullObserver;
+
+//
+//      In-Module Functions
+//
+const bux::C_FakeReply &reply(std::string_view sql)
+{
+    for (auto &i: g_replies)
+        if (sql.starts_with(i.first))
+            return i.second;
+
+    return g_ok;
+}
+
+void setReplies()
+{
+    g_replies.emplace_back("select v ", bux::C_FakeReply{.m_fields = {"v"}, .m_rows = {{"42"}}});
+
+    bux::C_FakeReply rows{.m_fields = {"a", "b", "c", "d"}};
+    for (int i = 0; i < 1000; ++i)
+        rows.m_rows.push_back({std::to_string(i), std::string(16, 'b'), std::nullopt, std::string(64, 'd')});
+    g_replies.emplace_back("select a,b,c,d ", std::move(rows));
+
+    for (size_t bytes: {1 << 10, 1 << 20})
+        g_replies.emplace_back("select b from blobs where id=" + std::to_string(bytes), bux::C_FakeReply{.m_fields = {"b"}, .m_rows = {{std::string(bytes, 'x')}}});
+
+    g_replies.emplace_back("insert into dup", bux::C_FakeReply{.m_errno = 1062, .m_error = "Duplicate entry '1' for key 'PRIMARY'"});
+    bux::setFakeReplier(reply);
+}
+
+} // namespace
+
+//
+//      Benchmarks
+//
+static void BM_ConnPing(benchmark::State &state)
+{
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    for (auto _: state)
+        benchmark::DoNotOptimize(mysql.mysql());
+}
+BENCHMARK(BM_ConnPing);
+
+static void BM_QueryString(benchmark::State &state)
+{
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    for (unsigned id = 0; auto _: state)
+        benchmark::DoNotOptimize(bux::queryString(mysql, "select v from kv where id=" + std::to_string(++id)));
+}
+BENCHMARK(BM_QueryString);
+
+static void BM_QueryRows(benchmark::State &state)
+{
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    for (auto _: state)
+        benchmark::DoNotOptimize(bux::queryRows(mysql, "select a,b,c,d from rows"));
+
+    state.SetItemsProcessed(state.iterations() * 1000);
+}
+BENCHMARK(BM_QueryRows);
+
+static void BM_StmtPointSelect(benchmark::State &state)
+{
+    if (state.range(0))
+        bux::addObserver(g_nullObserver);
+
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    stmt.prepare("select v from kv where id=?");
+    unsigned id = 0, v = 0;
+    for (auto _: state)
+    {
+        ++id;
+        stmt.bindParams([&](MYSQL_BIND *barr){
+            bux::bindInt(barr[0], id);
+        });
+        stmt.execBindResults([&](MYSQL_BIND *barr){
+            bux::bindInt(barr[0], v);
+        });
+        while (stmt.nextRow())
+            benchmark::DoNotOptimize(v);
+    }
+    if (state.range(0))
+        bux::removeObserver(g_nullObserver);
+}
+BENCHMARK(BM_StmtPointSelect)->ArgName("observer")->Arg(0)->Arg(1);
+
+static void BM_BindParams(benchmark::State &state)
+{
+    const auto n = static_cast<size_t>(state.range(0));
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    std::string sql = "insert into t values(?";
+    for (size_t i = 1; i < n; ++i)
+        sql += ",?";
+    stmt.prepare(sql += ')');
+
+    std::vector<int> values(n);
+    for (auto _: state)
+        stmt.bindParams([&](MYSQL_BIND *barr){
+            for (size_t i = 0; i < n; ++i)
+                bux::bindInt(barr[i], values[i]);
+        });
+}
+BENCHMARK(BM_BindParams)->RangeMultiplier(4)->Range(1, 256);
+
+static void BM_ExecFetchRows(benchmark::State &state)
+{
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    stmt.prepare("select a,b,c,d from rows");
+    for (auto _: state)
+        benchmark::DoNotOptimize(stmt.execFetchRows());
+
+    state.SetItemsProcessed(state.iterations() * 1000);
+}
+BENCHMARK(BM_ExecFetchRows);
+
+static void BM_GetLongBlob(benchmark::State &state)
+{
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    stmt.prepare("select b from blobs where id=" + std::to_string(state.range(0)));
+    for (auto _: state)
+    {
+        stmt.execBindResults([](MYSQL_BIND *barr){
+            bux::bindLongBlob(barr[0]);
+        });
+        if (!stmt.nextRow())
+        {
+            state.SkipWithError("Blob not found");
+            break;
+        }
+        benchmark::DoNotOptimize(stmt.getLongBlob(0));
+        while (stmt.nextRow());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetLongBlob)->Arg(1 << 10)->Arg(1 << 20);
+
+static void BM_ExecDuplicateThrow(benchmark::State &state)
+{
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    stmt.prepare("insert into dup values(1)");
+    for (auto _: state)
+        try
+        {
+            stmt.exec();
+        }
+        catch (const std::runtime_error &e)
+        {
+            benchmark::DoNotOptimize(e.what());
+        }
+}
+BENCHMARK(BM_ExecDuplicateThrow)->ThreadRange(1, 8);
+
+static void BM_ExecDuplicateNoThrow(benchmark::State &state)
+{
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    stmt.prepare("insert into dup values(1)");
+    for (auto _: state)
+        benchmark::DoNotOptimize(stmt.execNoThrow());
+}
+BENCHMARK(BM_ExecDuplicateNoThrow)->ThreadRange(1, 8);
+
+static void BM_ExecDuplicateTryExec(benchmark::State &state)
+{
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    stmt.prepare("insert into dup values(1)");
+    for (auto _: state)
+    {
+        const auto ret = stmt.tryExec();
+        benchmark::DoNotOptimize(ret.error().m_kind == bux::MYERR_DUPLICATE);
+    }
+}
+BENCHMARK(BM_ExecDuplicateTryExec)->ThreadRange(1, 8);
+
+int main(int argc, char **argv)
+{
+    if (!bux::initBenchmarks(argc, argv, "bux-mariadb-overhead.json"))
+        return 1;
+
+    setReplies();
+    benchmark::AddCustomContext("connector", "fake");
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
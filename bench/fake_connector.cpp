@@ -0,0 +1,611 @@
+﻿#include "fake_connector.h"
+#include <mysql/mysql.h>    // MYSQL, MYSQL_RES, MYSQL_STMT, MYSQL_BIND
+#include <algorithm>        // std::equal(), std::max(), std::min()
+#include <atomic>           // std::atomic<>
+#include <cctype>           // toupper()
+#include <charconv>         // std::from_chars()
+#include <cstdarg>          // va_list, va_start(), va_arg(), va_end()
+#include <cstring>          // memcpy()
+#include <map>              // std::map<>
+#include <type_traits>      // std::make_unsigned_t<>, std::is_integral_v<>
+
+namespace {
+
+//
+//      In-Module Types
+//
+struct C_FakeConn
+{
+    MYSQL               m_mysql{};  // First member so that MYSQL* can be cast back
+    const bux::C_FakeReply *m_pending{};    // Result set not yet taken by mysql_store_result() or mysql_use_result()
+    unsigned long long  m_affectedRows{}, m_insertId{};
+    unsigned long       m_threadId{};
+    unsigned            m_errno{};
+    std::string         m_error;
+    std::string         m_db;       // Pointed by m_mysql.db
+    std::map<std::string,void*> m_userData; // Of MARIADB_OPT_USERDATA
+
+    // Nonvirtuals
+    void useDb(const char *db)
+    {
+        m_db = db? db: "";
+        m_mysql.db = m_db.empty()? nullptr: m_db.data();
+    }
+};
+
+struct C_FakeResult
+{
+    const bux::C_FakeReply      &m_reply;
+    size_t                      m_next{};
+    std::vector<char*>          m_row;
+    std::vector<unsigned long>  m_lengths;
+    std::vector<MYSQL_FIELD>    m_fields;
+
+    C_FakeResult(const bux::C_FakeReply &reply): m_reply(reply),
+        m_row(reply.m_fields.size()), m_lengths(reply.m_fields.size()), m_fields(reply.m_fields.size())
+    {
+        for (size_t i = 0; i < m_fields.size(); ++i)
+        {
+            auto &name = reply.m_fields[i];
+            m_fields[i].name = const_cast<char*>(name.c_str());
+            m_fields[i].name_length = static_cast<unsigned>(name.size());
+            m_fields[i].type = MYSQL_TYPE_VAR_STRING;
+        }
+        for (auto &row: reply.m_rows)
+            // As computed by mysql_store_result()
+            for (size_t i = 0; i < std::min(row.size(), m_fields.size()); ++i)
+                if (row[i])
+                    m_fields[i].max_length = std::max(m_fields[i].max_length, static_cast<unsigned long>(row[i]->size()));
+    }
+};
+
+struct C_FakeStmt
+{
+    MYSQL_STMT              m_stmt{};   // First member so that MYSQL_STMT* can be cast back
+    const bux::C_FakeReply  *m_reply{};
+    std::vector<MYSQL_BIND> m_params;   // Pointed by m_stmt.params as if copied by libmariadb
+    std::vector<MYSQL_BIND> m_results;  // Pointed by m_stmt.bind as if copied by libmariadb
+    size_t                  m_next{};   // Index of the next row to fetch
+    unsigned long           m_paramCount{};
+    unsigned long long      m_affectedRows{};
+    unsigned                m_errno{};
+    std::string             m_error;
+    std::string             m_sql;
+};
+
+//
+//      In-Module Data
+//
+const bux::C_FakeReply      g_noResult;
+const bux::C_FakeReply      g_maxAllowedPacket{.m_fields = {"@@max_allowed_packet"}, .m_rows = {{"16777216"}}};
+bux::C_FakeReply            g_fixedReply;
+bux::F_FakeReplier          g_replier = [](std::string_view) -> const bux::C_FakeReply& { return g_noResult; };
+std::atomic<unsigned long>  g_nextThreadId{1};
+
+//
+//      In-Module Functions
+//
+C_FakeConn &fake(MYSQL *mysql) noexcept
+{
+    return *reinterpret_cast<C_FakeConn*>(mysql);
+}
+
+C_FakeResult &fake(MYSQL_RES *res) noexcept
+{
+    return *reinterpret_cast<C_FakeResult*>(res);
+}
+
+C_FakeStmt &fake(MYSQL_STMT *stmt) noexcept
+{
+    return *reinterpret_cast<C_FakeStmt*>(stmt);
+}
+
+const bux::C_FakeReply &replyTo(std::string_view sql)
+{
+    if (sql == "select @@max_allowed_packet")
+        // Asked by the wrapper itself
+        return g_maxAllowedPacket;
+
+    return g_replier(sql);
+}
+
+unsigned long countParams(std::string_view sql) noexcept
+{
+    unsigned long ret = 0;
+    char quote = 0;
+    for (auto c: sql)
+        if (quote)
+        {
+            if (c == quote)
+                quote = 0;
+        }
+        else if (c == '\'' || c == '"' || c == '`')
+            quote = c;
+        else if (c == '?')
+            ++ret;
+
+    return ret;
+}
+
+bool startsWith(std::string_view sql, std::string_view keyword) noexcept
+/*! \param [in] keyword In upper case
+*/
+{
+    return sql.size() >= keyword.size() && std::equal(keyword.begin(), keyword.end(), sql.begin(),
+        [](char a, char b){ return a == toupper(static_cast<unsigned char>(b)); });
+}
+
+void trackTransaction(MYSQL &mysql, std::string_view sql) noexcept
+{
+    if (startsWith(sql, "BEGIN") || startsWith(sql, "START TRANSACTION"))
+        mysql.server_status |= SERVER_STATUS_IN_TRANS;
+    else if (startsWith(sql, "COMMIT") || startsWith(sql, "ROLLBACK"))
+        mysql.server_status &= ~SERVER_STATUS_IN_TRANS;
+}
+
+template<class T>
+void storeNumber(MYSQL_BIND &dst, const std::string &src, unsigned long &length) noexcept
+{
+    if constexpr (std::is_integral_v<T>)
+        if (dst.is_unsigned)
+        {
+            std::make_unsigned_t<T> u{};
+            std::from_chars(src.data(), src.data() + src.size(), u);
+            memcpy(dst.buffer, &u, sizeof u);
+            length = sizeof u;
+            return;
+        }
+
+    T t{};
+    std::from_chars(src.data(), src.data() + src.size(), t);
+    memcpy(dst.buffer, &t, sizeof t);
+    length = sizeof t;
+}
+
+bool storeColumn(MYSQL_BIND &dst, const std::optional<std::string> &src) noexcept
+/*! \brief Convert \a src into \a dst like <tt>mysql_stmt_fetch()</tt> does
+    \return true if truncated
+*/
+{
+    auto &isNull = dst.is_null? *dst.is_null: dst.is_null_value;
+    auto &length = dst.length? *dst.length: dst.length_value;
+    auto &error = dst.error? *dst.error: dst.error_value;
+    isNull = !src;
+    error = false;
+    if (!src)
+    {
+        length = 0;
+        return false;
+    }
+    switch (dst.buffer_type)
+    {
+    case MYSQL_TYPE_TINY:
+        storeNumber<signed char>(dst, *src, length);
+        break;
+    case MYSQL_TYPE_SHORT:
+        storeNumber<short>(dst, *src, length);
+        break;
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_INT24:
+        storeNumber<int>(dst, *src, length);
+        break;
+    case MYSQL_TYPE_LONGLONG:
+        storeNumber<long long>(dst, *src, length);
+        break;
+    case MYSQL_TYPE_FLOAT:
+        storeNumber<float>(dst, *src, length);
+        break;
+    case MYSQL_TYPE_DOUBLE:
+        storeNumber<double>(dst, *src, length);
+        break;
+    default:
+        length = static_cast<unsigned long>(src->size());
+        if (dst.buffer)
+        {
+            memcpy(dst.buffer, src->data(), std::min(length, dst.buffer_length));
+            if (length < dst.buffer_length)
+                static_cast<char*>(dst.buffer)[length] = 0;
+        }
+        error = length > dst.buffer_length;
+    }
+    return error;
+}
+
+} // namespace
+
+namespace bux {
+
+//
+//      Functions
+//
+void setFakeReplier(F_FakeReplier replier)
+/*! \brief Let \a replier decide the reply to each query, or to each prepare and execute of a statement.
+
+    The returned reference must stay valid till the result is freed. Not to be called while connections are in use.
+*/
+{
+    g_replier = std::move(replier);
+}
+
+void setFakeReply(C_FakeReply reply)
+/*! \brief Reply \a reply to whatever SQL
+*/
+{
+    g_fixedReply = std::move(reply);
+    g_replier = [](std::string_view) -> const C_FakeReply& { return g_fixedReply; };
+}
+
+} // namespace bux
+
+//
+//      Connector/C Functions
+//
+MYSQL *mysql_init(MYSQL *mysql)
+{
+    if (mysql)
+        // Initialization in place is not faked
+        return nullptr;
+
+    const auto ret = new C_FakeConn;
+    ret->m_threadId = g_nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    return &ret->m_mysql;
+}
+
+int mysql_options(MYSQL*, enum mysql_option, const void*)
+{
+    return 0;
+}
+
+int mysql_optionsv(MYSQL *mysql, enum mysql_option option, ...)
+{
+    if (option != MARIADB_OPT_USERDATA)
+        return 0;
+
+    va_list ap;
+    va_start(ap, option);
+    const char *const key = va_arg(ap, char*);
+    void *const data = va_arg(ap, void*);
+    va_end(ap);
+    fake(mysql).m_userData[key] = data;
+    return 0;
+}
+
+int mysql_get_optionv(MYSQL *mysql, enum mysql_option option, void *arg, ...)
+{
+    if (option != MARIADB_OPT_USERDATA)
+        return 1;
+
+    va_list ap;
+    va_start(ap, arg);
+    void **const data = va_arg(ap, void**);
+    va_end(ap);
+    const auto &userData = fake(mysql).m_userData;
+    const auto found = userData.find(static_cast<const char*>(arg));
+    *data = found != userData.end()? found->second: nullptr;
+    return 0;
+}
+
+MYSQL *mysql_real_connect(MYSQL *mysql, const char*, const char*, const char*, const char *db, unsigned int, const char*, unsigned long)
+{
+    fake(mysql).useDb(db);
+    return mysql;
+}
+
+void mysql_close(MYSQL *mysql)
+{
+    delete &fake(mysql);
+}
+
+int mysql_select_db(MYSQL *mysql, const char *db)
+{
+    fake(mysql).useDb(db);
+    return 0;
+}
+
+int mysql_ping(MYSQL*)
+{
+    return 0;
+}
+
+unsigned long mysql_thread_id(MYSQL *mysql)
+{
+    return fake(mysql).m_threadId;
+}
+
+int mysql_query(MYSQL *mysql, const char *q)
+{
+    auto &conn = fake(mysql);
+    const auto &reply = replyTo(q);
+    conn.m_errno = reply.m_errno;
+    conn.m_error = reply.m_error;
+    if (reply.m_errno)
+    {
+        conn.m_pending = {};
+        return 1;
+    }
+    conn.m_pending = reply.m_fields.empty()? nullptr: &reply;
+    conn.m_affectedRows = reply.m_fields.empty()? reply.m_affectedRows: reply.m_rows.size();
+    conn.m_insertId = reply.m_insertId;
+    trackTransaction(conn.m_mysql, q);
+    return 0;
+}
+
+int mysql_next_result(MYSQL*)
+{
+    // One result set per query
+    return -1;
+}
+
+unsigned int mysql_errno(MYSQL *mysql)
+{
+    return fake(mysql).m_errno;
+}
+
+const char *mysql_error(MYSQL *mysql)
+{
+    return fake(mysql).m_error.c_str();
+}
+
+const char *mysql_sqlstate(MYSQL *mysql)
+{
+    return fake(mysql).m_errno? "HY000": "00000";
+}
+
+my_ulonglong mysql_affected_rows(MYSQL *mysql)
+{
+    return fake(mysql).m_affectedRows;
+}
+
+my_ulonglong mysql_insert_id(MYSQL *mysql)
+{
+    return fake(mysql).m_insertId;
+}
+
+unsigned int mysql_field_count(MYSQL *mysql)
+{
+    const auto pending = fake(mysql).m_pending;
+    return pending? static_cast<unsigned>(pending->m_fields.size()): 0;
+}
+
+MYSQL_RES *mysql_store_result(MYSQL *mysql)
+{
+    auto &conn = fake(mysql);
+    if (!conn.m_pending)
+        return nullptr;
+
+    const auto ret = new C_FakeResult(*conn.m_pending);
+    conn.m_pending = {};
+    return reinterpret_cast<MYSQL_RES*>(ret);
+}
+
+MYSQL_RES *mysql_use_result(MYSQL *mysql)
+{
+    return mysql_store_result(mysql);
+}
+
+void mysql_free_result(MYSQL_RES *res)
+{
+    if (res)
+        delete &fake(res);
+}
+
+MYSQL_ROW mysql_fetch_row(MYSQL_RES *res)
+{
+    auto &r = fake(res);
+    if (r.m_next >= r.m_reply.m_rows.size())
+        return nullptr;
+
+    const auto &row = r.m_reply.m_rows[r.m_next++];
+    for (size_t i = 0; i < r.m_row.size(); ++i)
+        if (i < row.size() && row[i])
+        {
+            r.m_row[i] = const_cast<char*>(row[i]->c_str());
+            r.m_lengths[i] = static_cast<unsigned long>(row[i]->size());
+        }
+        else
+        {
+            r.m_row[i] = nullptr;
+            r.m_lengths[i] = 0;
+        }
+    return r.m_row.data();
+}
+
+unsigned long *mysql_fetch_lengths(MYSQL_RES *res)
+{
+    return fake(res).m_lengths.data();
+}
+
+MYSQL_FIELD *mysql_fetch_fields(MYSQL_RES *res)
+{
+    return fake(res).m_fields.data();
+}
+
+unsigned int mysql_num_fields(MYSQL_RES *res)
+{
+    return static_cast<unsigned>(fake(res).m_fields.size());
+}
+
+my_ulonglong mysql_num_rows(MYSQL_RES *res)
+{
+    return fake(res).m_reply.m_rows.size();
+}
+
+void mysql_data_seek(MYSQL_RES *res, unsigned long long offset)
+{
+    fake(res).m_next = offset;
+}
+
+unsigned long mysql_real_escape_string(MYSQL*, char *to, const char *from, unsigned long length)
+{
+    const auto start = to;
+    for (unsigned long i = 0; i < length; ++i)
+    {
+        char c = from[i];
+        switch (c)
+        {
+        case 0:
+            c = '0';
+            break;
+        case '\n':
+            c = 'n';
+            break;
+        case '\r':
+            c = 'r';
+            break;
+        case '\032':
+            c = 'Z';
+            break;
+        case '\\':
+        case '\'':
+        case '"':
+            break;
+        default:
+            *to++ = c;
+            continue;
+        }
+        *to++ = '\\';
+        *to++ = c;
+    }
+    *to = 0;
+    return static_cast<unsigned long>(to - start);
+}
+
+MYSQL_STMT *mysql_stmt_init(MYSQL *mysql)
+{
+    const auto ret = new C_FakeStmt;
+    ret->m_stmt.mysql = mysql;
+    return &ret->m_stmt;
+}
+
+my_bool mysql_stmt_close(MYSQL_STMT *stmt)
+{
+    delete &fake(stmt);
+    return 0;
+}
+
+int mysql_stmt_prepare(MYSQL_STMT *stmt, const char *query, unsigned long length)
+{
+    auto &s = fake(stmt);
+    s.m_sql.assign(query, length);
+    s.m_reply = &replyTo(s.m_sql);
+    s.m_paramCount = countParams(s.m_sql);
+    s.m_next = s.m_reply->m_rows.size();
+    s.m_errno = 0;
+    s.m_error.clear();
+    return 0;
+}
+
+unsigned long mysql_stmt_param_count(MYSQL_STMT *stmt)
+{
+    return fake(stmt).m_paramCount;
+}
+
+unsigned int mysql_stmt_field_count(MYSQL_STMT *stmt)
+{
+    const auto reply = fake(stmt).m_reply;
+    return reply? static_cast<unsigned>(reply->m_fields.size()): 0;
+}
+
+my_bool mysql_stmt_bind_param(MYSQL_STMT *stmt, MYSQL_BIND *bnd)
+{
+    auto &s = fake(stmt);
+    s.m_params.assign(bnd, bnd + s.m_paramCount);
+    s.m_stmt.params = s.m_params.data();
+    return 0;
+}
+
+my_bool mysql_stmt_send_long_data(MYSQL_STMT*, unsigned int, const char*, unsigned long)
+{
+    return 0;
+}
+
+int mysql_stmt_execute(MYSQL_STMT *stmt)
+{
+    auto &s = fake(stmt);
+    s.m_reply = &replyTo(s.m_sql);
+    s.m_errno = s.m_reply->m_errno;
+    s.m_error = s.m_reply->m_error;
+    if (s.m_errno)
+    {
+        s.m_next = s.m_reply->m_rows.size();
+        return 1;
+    }
+    s.m_next = 0;
+    s.m_affectedRows = s.m_reply->m_fields.empty()? s.m_reply->m_affectedRows: s.m_reply->m_rows.size();
+    fake(s.m_stmt.mysql).m_insertId = s.m_reply->m_insertId;
+    return 0;
+}
+
+my_bool mysql_stmt_bind_result(MYSQL_STMT *stmt, MYSQL_BIND *bnd)
+{
+    auto &s = fake(stmt);
+    s.m_results.assign(bnd, bnd + mysql_stmt_field_count(stmt));
+    s.m_stmt.bind = s.m_results.data();
+    return 0;
+}
+
+MYSQL_RES *mysql_stmt_result_metadata(MYSQL_STMT *stmt)
+{
+    const auto reply = fake(stmt).m_reply;
+    return reply && !reply->m_fields.empty()? reinterpret_cast<MYSQL_RES*>(new C_FakeResult(*reply)): nullptr;
+}
+
+int mysql_stmt_fetch(MYSQL_STMT *stmt)
+{
+    auto &s = fake(stmt);
+    if (!s.m_reply || s.m_next >= s.m_reply->m_rows.size())
+        return MYSQL_NO_DATA;
+
+    const auto &row = s.m_reply->m_rows[s.m_next++];
+    bool truncated = false;
+    for (size_t i = 0; i < std::min(row.size(), s.m_results.size()); ++i)
+        truncated |= storeColumn(s.m_results[i], row[i]);
+
+    return truncated? MYSQL_DATA_TRUNCATED: 0;
+}
+
+int mysql_stmt_fetch_column(MYSQL_STMT *stmt, MYSQL_BIND *bind_arg, unsigned int column, unsigned long offset)
+{
+    auto &s = fake(stmt);
+    if (!s.m_reply || !s.m_next || s.m_next > s.m_reply->m_rows.size())
+    {
+        s.m_errno = 2051; // CR_NO_DATA
+        s.m_error = "Attempt to read column without prior row fetch";
+        return 1;
+    }
+    const auto &row = s.m_reply->m_rows[s.m_next - 1];
+    static const std::optional<std::string> none;
+    const auto &src = column < row.size()? row[column]: none;
+    auto &isNull = bind_arg->is_null? *bind_arg->is_null: bind_arg->is_null_value;
+    auto &length = bind_arg->length? *bind_arg->length: bind_arg->length_value;
+    isNull = !src;
+    length = src? static_cast<unsigned long>(src->size()): 0;
+    if (src && offset < length)
+        memcpy(bind_arg->buffer, src->data() + offset, std::min(length - offset, bind_arg->buffer_length));
+
+    return 0;
+}
+
+my_bool mysql_stmt_free_result(MYSQL_STMT *stmt)
+{
+    auto &s = fake(stmt);
+    if (s.m_reply)
+        s.m_next = s.m_reply->m_rows.size();
+
+    return 0;
+}
+
+unsigned int mysql_stmt_errno(MYSQL_STMT *stmt)
+{
+    return fake(stmt).m_errno;
+}
+
+const char *mysql_stmt_error(MYSQL_STMT *stmt)
+{
+    return fake(stmt).m_error.c_str();
+}
+
+my_ulonglong mysql_stmt_affected_rows(MYSQL_STMT *stmt)
+{
+    return fake(stmt).m_affectedRows;
+}
@@ -0,0 +1,40 @@
+﻿#pragma once
+
+/*! \file
+    \brief Link-time fake of the Connector/C functions called by the wrapper, replying canned results with zero latency
+
+    Link \c bux-mariadb-fake-connector instead of \c libmariadb to measure or test the client-side overhead
+    alone, e.g. \c std::function calls, bind arrays, string building and exceptions, without any server.
+*/
+
+#include <functional>       // std::function<>
+#include <optional>         // std::optional<>
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector<>
+
+namespace bux {
+
+//
+//      Types
+//
+struct C_FakeReply
+/// \brief Canned reply to a query, or to a prepare and execute of a statement
+{
+    std::vector<std::string>                                m_fields{}; ///< Empty if no result set
+    std::vector<std::vector<std::optional<std::string>>>    m_rows{};
+    unsigned long long  m_affectedRows{};
+    unsigned long long  m_insertId{};
+    unsigned            m_errno{};      ///< Nonzero to fail mysql_query() and mysql_stmt_execute()
+    std::string         m_error{};
+};
+
+using F_FakeReplier = std::function<const C_FakeReply&(std::string_view sql)>;
+
+//
+//      Externs
+//
+void setFakeReplier(F_FakeReplier replier);
+void setFakeReply(C_FakeReply reply);
+
+} // namespace bux
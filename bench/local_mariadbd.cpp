@@ -0,0 +1,164 @@
+﻿#include "local_mariadbd.h"
+#include <bux/XException.h> // RUNTIME_ERROR()
+#include <chrono>           // std::chrono::steady_clock
+#include <csignal>          // kill(), SIGTERM
+#include <cstdlib>          // getenv(), mkdtemp()
+#include <cstring>          // strerror()
+#include <format>           // std::format()
+#include <spawn.h>          // posix_spawnp()
+#include <string>           // std::string
+#include <sys/wait.h>       // waitpid()
+#include <thread>           // std::this_thread::sleep_for()
+#include <unistd.h>         // geteuid()
+#include <vector>           // std::vector<>
+
+extern char **environ;
+
+namespace {
+
+//
+//      In-Module Constants
+//
+constexpr auto READY_TIMEOUT = std::chrono::seconds(60);
+
+//
+//      In-Module Functions
+//
+std::vector<std::string> commonArgs(const char *exe, const std::filesystem::path &datadir)
+{
+    std::vector<std::string> ret{exe, "--no-defaults", "--datadir=" + datadir.string()};
+    if (!geteuid())
+        // mariadbd refuses to run as root otherwise
+        ret.emplace_back("--user=root");
+
+    return ret;
+}
+
+const char *envOr(const char *name, const char *def) noexcept
+{
+    const auto ret = getenv(name);
+    return ret && *ret? ret: def;
+}
+
+pid_t spawn(std::vector<std::string> args)
+{
+    std::vector<char*> argv;
+    for (auto &i: args)
+        argv.emplace_back(i.data());
+    argv.emplace_back(nullptr);
+
+    pid_t pid;
+    if (const int err = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ))
+        RUNTIME_ERROR("Fail to spawn {}: {}", args[0], strerror(err));
+
+    return pid;
+}
+
+int waitExit(pid_t pid)
+/*! \return Exit code of \a pid, or -1 if killed by signal
+*/
+{
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            RUNTIME_ERROR("waitpid({}) fails with errno {}", pid, errno);
+
+    return WIFEXITED(status)? WEXITSTATUS(status): -1;
+}
+
+} // namespace
+
+namespace bux {
+
+//
+//      Implement Classes
+//
+C_LocalMariadbd::C_LocalMariadbd(unsigned port): m_port(port)
+{
+    auto tmpl = (std::filesystem::temp_directory_path() / "bux-mariadbd-XXXXXX").string();
+    if (!mkdtemp(tmpl.data()))
+        RUNTIME_ERROR("Fail to create temporary datadir {}", tmpl);
+
+    m_datadir = tmpl;
+    try
+    {
+        auto args = commonArgs(envOr("MARIADB_INSTALL_DB", "mariadb-install-db"), m_datadir);
+        args.insert(args.end(), {"--auth-root-authentication-method=normal", "--skip-test-db"});
+        if (const auto code = waitExit(spawn(std::move(args))))
+            RUNTIME_ERROR("mariadb-install-db exits with {}", code);
+
+        args = commonArgs(envOr("MARIADBD", "mariadbd"), m_datadir);
+        args.insert(args.end(), {
+            std::format("--port={}", port),
+            "--bind-address=127.0.0.1",
+            "--socket=" + (m_datadir / "mariadbd.sock").string(),
+            "--log-error=" + (m_datadir / "error.log").string(),
+            "--skip-name-resolve",
+            "--innodb-flush-log-at-trx-commit=0",
+            "--innodb-buffer-pool-size=256M",
+            "--max-allowed-packet=64M"});
+        m_pid = spawn(std::move(args));
+        waitReady();
+    }
+    catch (...)
+    {
+        if (m_pid)
+        {
+            kill(m_pid, SIGTERM);
+            waitExit(m_pid);
+        }
+        // m_datadir is kept for its error.log
+        throw;
+    }
+}
+
+C_LocalMariadbd::~C_LocalMariadbd()
+{
+    if (m_pid)
+    {
+        kill(m_pid, SIGTERM);
+        try
+        {
+            waitExit(m_pid);
+        }
+        catch (...)
+        {
+            // Nothing to do
+        }
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(m_datadir, ec);
+}
+
+C_MyConnectArg C_LocalMariadbd::connectArg() const
+{
+    return {"127.0.0.1", "root", {}, {}, "utf8mb4", m_port};
+}
+
+void C_LocalMariadbd::waitReady()
+{
+    const auto deadline = std::chrono::steady_clock::now() + READY_TIMEOUT;
+    for (;;)
+    {
+        int status;
+        if (waitpid(m_pid, &status, WNOHANG) == m_pid)
+        {
+            m_pid = 0;
+            RUNTIME_ERROR("mariadbd exits prematurely. See {}", (m_datadir / "error.log").string());
+        }
+        try
+        {
+            C_MySQL probe{connectArg()};
+            probe.mysql();
+            return;
+        }
+        catch (const std::exception &e)
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                RUNTIME_ERROR("mariadbd not ready in {}: {}", READY_TIMEOUT, e.what());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+} // namespace bux
@@ -0,0 +1,44 @@
+﻿#pragma once
+
+/*! \file
+    \brief Throwaway local mariadbd for benchmarks
+*/
+
+#include <bux/oo_mariadb.h> // bux::C_MyConnectArg
+#include <filesystem>       // std::filesystem::path
+#include <sys/types.h>      // pid_t
+
+namespace bux {
+
+//
+//      Types
+//
+class C_LocalMariadbd
+/*! \brief Initialize a temporary datadir by <tt>mariadb-install-db</tt>, run <tt>mariadbd</tt> over it listening on
+    127.0.0.1 only, and shut it down and remove the datadir on destruction.
+
+    Executables are searched in \c PATH unless overridden by environment variables \c MARIADBD and
+    \c MARIADB_INSTALL_DB. Durability is traded off for less disk noise in measurements.
+*/
+{
+public:
+
+    // Nonvirtuals
+    explicit C_LocalMariadbd(unsigned port);
+    ~C_LocalMariadbd();
+    C_LocalMariadbd(const C_LocalMariadbd&) = delete;
+    C_LocalMariadbd &operator=(const C_LocalMariadbd&) = delete;
+    C_MyConnectArg connectArg() const;
+
+private:
+
+    // Data
+    std::filesystem::path   m_datadir;
+    const unsigned          m_port;
+    pid_t                   m_pid{};
+
+    // Nonvirtuals
+    void waitReady();
+};
+
+} // namespace bux
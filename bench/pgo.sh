@@ -0,0 +1,61 @@
+#!/bin/bash
+# Rebuild bux-mariadb-client with profile-guided optimization trained on the benchmarks, and compare
+# bux-mariadb-overhead (plus bux-mariadb-bench if built) before and after.
+#
+# usage: bench/pgo.sh [build-dir] [cmake-args...]
+#   e.g. bench/pgo.sh _pgo -D FETCH_DEPENDEES=1 -D DEPENDEE_ROOT=_deps -D BUX_MY_LTO=ON
+set -e
+src=$(cd "$(dirname "$0")/.." && pwd)
+dir=$(realpath -m "${1:-_pgo}")
+shift || true
+
+build() {
+    cmake -S "$src" -B "$dir" -D CMAKE_BUILD_TYPE=Release -D BUX_MY_BENCH=ON -D BUX_MY_PGO="$1" "${@:2}"
+    cmake --build "$dir" -j"$(nproc)" --target bux-mariadb-overhead
+    cmake --build "$dir" -j"$(nproc)" --target bux-mariadb-bench 2>/dev/null || true
+}
+
+# $1 = suffix of JSON outputs, the rest = extra benchmark arguments
+run() {
+    local tag=$1
+    shift
+    "$dir/bench/bux-mariadb-overhead" --benchmark_out="$dir/overhead-$tag.json" --benchmark_out_format=json "$@"
+    if [[ -x "$dir/bench/bux-mariadb-bench" ]]; then
+        "$dir/bench/bux-mariadb-bench" --benchmark_out="$dir/bench-$tag.json" --benchmark_out_format=json "$@" ||
+            echo "bux-mariadb-bench failed: its results are left out" >&2
+    fi
+}
+
+# 1. Baseline
+build "" "$@"
+run nopgo --benchmark_repetitions=3
+
+# 2. Train. GCC names profiles after object paths, so the same build dir is reused throughout.
+rm -rf "$dir/pgo"
+build GENERATE "$@"
+run train --benchmark_min_time=0.05
+if compgen -G "$dir/pgo/*.profraw" > /dev/null; then
+    llvm-profdata merge -o "$dir/pgo/default.profdata" "$dir"/pgo/*.profraw
+fi
+
+# 3. Rebuild with the profile and measure again
+build USE "$@"
+run pgo --benchmark_repetitions=3
+
+# 4. Compare the mean real time of each benchmark
+for tag in overhead bench; do
+    [[ -f "$dir/$tag-nopgo.json" && -f "$dir/$tag-pgo.json" ]] || continue
+    python3 - "$dir/$tag-nopgo.json" "$dir/$tag-pgo.json" <<'EOF'
+import json, sys
+
+def means(path):
+    with open(path) as f:
+        return {b["run_name"]: b["real_time"] for b in json.load(f)["benchmarks"] if b.get("aggregate_name") == "mean"}
+
+before, after = means(sys.argv[1]), means(sys.argv[2])
+print(f"\n{'benchmark':<60}{'nopgo':>14}{'pgo':>14}{'change':>9}")
+for name, t in before.items():
+    if name in after:
+        print(f"{name:<60}{t:>14.1f}{after[name]:>14.1f}{(after[name] - t) / t:>+9.1%}")
+EOF
+done
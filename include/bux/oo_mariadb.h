@@ -5,13 +5,18 @@
 */
 
 #include <mysql/mysql.h>    // MYSQL, MYSQL_RES, MYSQL_STMT, MYSQL_BIND
+#include <atomic>           // std::atomic<>
+#include <chrono>           // std::chrono::milliseconds, std::chrono::steady_clock
 #include <concepts>         // std::integral<>, std::convertible_to<>, std::invocable<>
+#include <expected>         // std::expected<>
 #include <functional>       // std::function<>
 #include <limits>           // std::numeric_limits<>
 #include <map>              // std::map<>
-#include <memory>           // std::unique_ptr<>
+#include <memory>           // std::unique_ptr<>, std::shared_ptr<>, std::enable_shared_from_this<>
 #include <optional>         // std::optional<>
 #include <string>           // std::string
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector<>
 
 namespace bux {
 
@@ -25,6 +30,48 @@ enum E_MySqlResultKind
     MYSQL_STORE_RESULT  ///< mysql_store_result()
 };
 
+enum E_MyCapAction
+/// \brief What to do with a result exceeding C_MyMemoryCap
+{
+    MYCAP_FAIL,     ///< Throw std::runtime_error once a result or a blob is known to exceed the cap
+    MYCAP_STREAM    ///< Let query(..., MYSQL_STORE_RESULT) return an unbuffered result as if by MYSQL_USE_RESULT,
+                    ///< since no result can be measured before buffered
+};
+
+enum E_MyErrorKind
+/// \brief How the caller is expected to react to C_MyError
+{
+    MYERR_RETRYABLE,    ///< Lock wait timeout or deadlock, rolled back by the server: retry the transaction
+    MYERR_CONNECTION,   ///< Lost connection: the outcome, e.g. of \c COMMIT, is unknown, so retry only what is idempotent
+    MYERR_DUPLICATE,    ///< Duplicate key: the row is already there
+    MYERR_FATAL         ///< Anything else
+};
+
+struct C_MyError
+/// \brief Error returned instead of thrown by the <tt>try*()</tt> family
+{
+    unsigned        m_errno;    ///< mysql_errno() or mysql_stmt_errno(), 0 if not from Connector/C
+    E_MyErrorKind   m_kind;
+    std::string     m_what;     ///< Same as what() of the exception the throwing counterpart would throw
+
+    // Nonvirtuals
+    C_MyError(unsigned errNo, std::string what);
+};
+
+template<class T>
+using T_MyExpected = std::expected<T,C_MyError>;
+
+struct C_MyConnCounters: std::enable_shared_from_this<C_MyConnCounters>
+/*! \brief Per-connection counters, accumulated across reconnections
+
+    Owned by C_MySQL and shared with statements and results of its connection, which find them by the
+    Connector/C user data of the connection, so that no global registry is needed.
+*/
+{
+    std::atomic<unsigned long long> m_roundTrips{};
+    std::atomic<long long>          m_heldBytes{};  ///< Of stored results and bind arrays
+};
+
 class [[nodiscard]]C_MySqlResult
 /*! \brief Owner class of <a href="https://dev.mysql.com/doc/refman/5.7/en/mysql-use-result.html">MYSQL_RES *</a>
     which is intended to be directly passed to original MySQL API, e.g. <tt>mysql_fetch_row()</tt>
@@ -34,21 +81,46 @@ public:
 
     // Nonvirtuals
     C_MySqlResult(MYSQL_RES *res): m_res(res) {}
+    C_MySqlResult(MYSQL_RES *res, MYSQL *mysql, size_t bytes);
     ~C_MySqlResult() { destroy(); }
-    C_MySqlResult(C_MySqlResult &&t): m_res(t.m_res) { t.m_res = {}; }
+    C_MySqlResult(C_MySqlResult &&t): m_res(t.m_res), m_counters(std::move(t.m_counters)), m_bytes(t.m_bytes) { t.m_res = {}; }
     void operator=(C_MySqlResult &&t) noexcept;
+    auto bytes() const { return m_bytes; }
     operator MYSQL_RES*() const { return m_res; }
 
 private:
 
-    MYSQL_RES   *m_res;
+    MYSQL_RES                           *m_res;
+    std::shared_ptr<C_MyConnCounters>   m_counters; // Counting m_bytes, if the connection is owned by C_MySQL
+    size_t                              m_bytes{};
 
     // Nonvirtuals
     void destroy();
 };
 
+struct C_MyLockStats
+/// \brief Counters of lock acquisitions, shared by all connections, as returned by advisoryLockStats() or tableLockStats()
+{
+    std::atomic<unsigned long long> m_acquired{};   ///< Successful acquisitions
+    std::atomic<unsigned long long> m_failed{};     ///< Timeouts and errors
+    std::atomic<unsigned long long> m_waitNs{};     ///< Total time spent acquiring, in nanoseconds
+
+    // Nonvirtuals
+    void add(std::chrono::steady_clock::duration wait, bool acquired) noexcept;
+};
+
+struct C_MyRowSet
+/// \brief Fully materialized result set which outlives the connection it is fetched from
+{
+    std::vector<std::string>                                m_fields;
+    std::vector<std::vector<std::optional<std::string>>>    m_rows;
+};
+
 class C_MySqlStmt
-/// \brief Owner class of <a href="https://dev.mysql.com/doc/refman/5.7/en/c-api-prepared-statement-functions.html">MYSQL_STMT *</a> with recurring methods
+/*! \brief Owner class of <a href="https://dev.mysql.com/doc/refman/5.7/en/c-api-prepared-statement-functions.html">MYSQL_STMT *</a> with recurring methods
+
+    Movable so that statements can be held by value in containers. A moved-from instance can only be destroyed or assigned to.
+*/
 {
 public:
 
@@ -56,7 +128,9 @@ public:
     C_MySqlStmt(MYSQL *mysql);
     ~C_MySqlStmt();
     C_MySqlStmt(const C_MySqlStmt &stmt) = delete;
+    C_MySqlStmt(C_MySqlStmt &&t) noexcept;
     C_MySqlStmt &operator=(const C_MySqlStmt &) = delete;
+    C_MySqlStmt &operator=(C_MySqlStmt &&t) noexcept;
     operator MYSQL_STMT*() const { return m_stmt; }
     bool affected() const;
     auto bindSize() const { return m_bindSize; }
@@ -64,25 +138,45 @@ public:
     void clear() const;
     void exec() const;
     MYSQL_BIND *execBindResults(const std::function<void(MYSQL_BIND *barr)> &binder);
+    C_MyRowSet execFetchRows();
     unsigned execNoThrow() const;
+    std::vector<unsigned long long> execReturningIds();
     std::pair<const void*,size_t> getLongBlob(size_t i, std::function<void*(size_t bytes)> alloc) const;
     std::string getLongBlob(size_t i) const;
     bool nextRow() const;
     void prepare(const std::string &sql) const;
     bool queryUint(unsigned &dst);
+    auto &sql() const { return m_sql; }
+    T_MyExpected<void> tryBindParams(const std::function<void(MYSQL_BIND *barr)> &binder);
+    T_MyExpected<void> tryExec() const;
+    T_MyExpected<MYSQL_BIND*> tryExecBindResults(const std::function<void(MYSQL_BIND *barr)> &binder);
+    T_MyExpected<C_MyRowSet> tryExecFetchRows();
+    T_MyExpected<std::vector<unsigned long long>> tryExecReturningIds();
+    T_MyExpected<std::pair<const void*,size_t>> tryGetLongBlob(size_t i, std::function<void*(size_t bytes)> alloc) const;
+    T_MyExpected<std::string> tryGetLongBlob(size_t i) const;
+    T_MyExpected<bool> tryNextRow() const;
+    T_MyExpected<void> tryPrepare(const std::string &sql) const;
 
 private:
 
     // Data
-    MYSQL_STMT              *const m_stmt;
+    MYSQL_STMT              *m_stmt;
+    mutable std::string     m_sql;
     size_t                  m_bindSize{0}, m_bindSizeLimit{0};
     std::unique_ptr<MYSQL_BIND[]> m_bindArr;
+    mutable unsigned long   m_boundParams{0};   // Count of parameters bound to m_stmt->params since prepare()
     mutable unsigned        m_maxPacketBytes{0};
+    std::shared_ptr<C_MyConnCounters> m_counters;   // Of the C_MySQL owning the connection, if any
 
     // Nonvirtuals
     void allocBind(size_t count);
     MYSQL_BIND *bindArray() const { return m_bindArr.get(); }
-    unsigned maxAllowedPacket() const;
+    void destroy() noexcept;
+    unsigned execute(bool retryDeadlock) const;
+    T_MyExpected<MYSQL_BIND*> executeBindResults(const std::function<void(MYSQL_BIND *barr)> &binder, bool retryDeadlock);
+    T_MyExpected<C_MyRowSet> executeFetchRows(bool retryDeadlock);
+    T_MyExpected<std::vector<unsigned long long>> executeReturningIds(bool retryDeadlock);
+    T_MyExpected<unsigned> tryMaxAllowedPacket() const;
 };
 
 struct C_MyConnectArg
@@ -94,21 +188,33 @@ struct C_MyConnectArg
 class C_MySQL
 /*! \brief <tt>MYSQL*</tt> wrapper class, which is thread-aware but not thread-safe.
             Use mutex to guard the use of C_MySQL instance or there will be trouble.
+
+    Movable, with the connection, its counters and the statement of stmt() taken over, so that connections can be
+    held by value in containers. A moved-from instance is disconnected but reconnects on demand, sharing the
+    connection argument getter with the instance moved to and with dup()'s, so that moves never copy it.
 */
 {
 public:
 
+    // Types
+    using F_GetConnArg = std::function<C_MyConnectArg()>;
+
     // Nonvirtuals
     C_MySQL(std::invocable<> auto getConnArg) requires requires { {getConnArg()}->std::convertible_to<C_MyConnectArg>; }:
-        m_getConnArg(getConnArg) {}
+        m_getConnArg(std::make_shared<const F_GetConnArg>(getConnArg)) {}
     C_MySQL(std::convertible_to<C_MyConnectArg> auto connArg):
-        m_getConnArg([connArg]{ return connArg; }) {}
+        m_getConnArg(std::make_shared<const F_GetConnArg>([connArg]{ return connArg; })) {}
     ~C_MySQL();
     C_MySQL(const C_MySQL&) = delete;
+    C_MySQL(C_MySQL &&t) noexcept;
     C_MySQL &operator=(const C_MySQL&) = delete;
+    C_MySQL &operator=(C_MySQL &&t) noexcept;
     void disconnect();
-    auto dup() const { return std::make_unique<C_MySQL>(m_getConnArg); }
+    C_MySQL dup() const { return C_MySQL{m_getConnArg}; }
     MYSQL *mysql();
+    T_MyExpected<MYSQL*> tryMysql();
+    long long memoryHeld() const { return m_counters? m_counters->m_heldBytes.load(std::memory_order_relaxed): 0; }
+    unsigned long long roundTrips() const { return m_counters? m_counters->m_roundTrips.load(std::memory_order_relaxed): 0; }
     C_MySqlStmt &stmt();
     unsigned long threadId();
 
@@ -121,14 +227,79 @@ protected:
 
     // Virtuals
     virtual void connect_();
+    virtual T_MyExpected<void> tryConnect_();
 
 private:
 
     // Data
-    std::function<C_MyConnectArg()> const m_getConnArg;
+    std::shared_ptr<const F_GetConnArg> m_getConnArg;   // Never null
     MYSQL                           *m_mysql{};
     unsigned long                   m_threadID{};
-    std::unique_ptr<C_MySqlStmt>    m_pstmt;
+    std::optional<C_MySqlStmt>      m_pstmt;
+    std::shared_ptr<C_MyConnCounters> m_counters;   // Created on the first connection
+
+    // Nonvirtuals
+    explicit C_MySQL(std::shared_ptr<const F_GetConnArg> getConnArg) noexcept: m_getConnArg(std::move(getConnArg)) {}
+    bool alive();
+    void takeOver(C_MySQL &t) noexcept;
+};
+
+class C_MyRoundTripScope
+/*! \brief Count server round trips issued by the current thread during the lifetime, e.g. of a request handler.
+
+    Scopes nest and each of them counts all round trips of its inner scopes.
+*/
+{
+public:
+
+    // Nonvirtuals
+    explicit C_MyRoundTripScope(const char *name = "") noexcept;
+    ~C_MyRoundTripScope();
+    C_MyRoundTripScope(const C_MyRoundTripScope &) = delete;
+    C_MyRoundTripScope &operator=(const C_MyRoundTripScope &) = delete;
+    auto count() const { return m_count; }
+    auto name() const { return m_name; }
+
+private:
+
+    // Data
+    C_MyRoundTripScope  *const m_outer;
+    const char          *const m_name;
+    unsigned long long  m_count{};
+
+    friend void countRoundTrip(C_MyConnCounters *counters) noexcept;
+};
+
+class C_MyMemoryCap
+/*! \brief Cap the bytes of any single result or blob buffered by the current thread during the lifetime.
+
+    Applied to query() returning C_MySqlResult, queryRows(), C_MySqlStmt::execFetchRows() and
+    C_MySqlStmt::getLongBlob() as a whole, and to queryEachRow() and queryColumn() row by row. Only
+    query(..., MYSQL_STORE_RESULT) can switch to streaming; the others materialize by nature and always fail.
+    Stored results are always counted by memoryHeld(), measured row by row under a cap but otherwise
+    estimated from the row count and column max lengths. Connector/C buffers a stored result as a whole
+    before it can be measured, so only MYCAP_STREAM keeps it from being buffered.
+    Scopes nest and the innermost wins.
+*/
+{
+public:
+
+    // Nonvirtuals
+    explicit C_MyMemoryCap(size_t maxBytes, E_MyCapAction action = MYCAP_FAIL) noexcept;
+    ~C_MyMemoryCap();
+    C_MyMemoryCap(const C_MyMemoryCap &) = delete;
+    C_MyMemoryCap &operator=(const C_MyMemoryCap &) = delete;
+    auto action() const { return m_action; }
+    static const C_MyMemoryCap *current() noexcept;
+    void check(size_t bytes, const std::string &what) const;
+    auto maxBytes() const { return m_maxBytes; }
+
+private:
+
+    // Data
+    const C_MyMemoryCap *const  m_outer;
+    const size_t                m_maxBytes;
+    const E_MyCapAction         m_action;
 };
 
 class C_LockTablesTillEnd
@@ -158,29 +329,82 @@ private:
         LS_BY_SPEC,
         LS_ALL_READ
     };
+    enum E_LockMode
+    {
+        LM_READ,
+        LM_WRITE
+    };
 
     // Data
     C_MySQL                             &m_mysql;
-    std::map<std::string,const char*>   m_spec;
+    std::map<std::string,E_LockMode>    m_spec;
+    std::map<std::string,E_LockMode>    m_held;     // Tables locked by the last lock()
     E_LockState                         m_state;
+    unsigned long                       m_threadId{};   // Of the connection holding the locks
+
+    // Nonvirtuals
+    MYSQL *holder();
+    void timedLock(MYSQL *mysql, const std::string &sql);
+};
+
+class C_MyAdvisoryLock
+/*! \brief Hold named advisory locks by <tt>GET_LOCK()</tt> till destruction or unlock().
+
+    All names are requested in one statement in sorted order, so that holders of overlapping names
+    never deadlock each other. If any of them is not acquired within the timeout, those acquired
+    are released and the constructor throws.
+*/
+{
+public:
+
+    // Nonvirtuals
+    C_MyAdvisoryLock(C_MySQL &mysql, std::string name, std::chrono::milliseconds timeout);
+    C_MyAdvisoryLock(C_MySQL &mysql, std::vector<std::string> names, std::chrono::milliseconds timeout);
+    ~C_MyAdvisoryLock();
+    C_MyAdvisoryLock(const C_MyAdvisoryLock &) = delete;
+    C_MyAdvisoryLock &operator=(const C_MyAdvisoryLock &) = delete;
+    auto &names() const { return m_names; }
+    void unlock();
+    auto &mysql() const { return m_mysql; }
+
+private:
+
+    // Data
+    C_MySQL                     &m_mysql;
+    std::vector<std::string>    m_names;    // Sorted, unique and held
 };
 
 //
 //      Externs
 //
+C_MyLockStats &advisoryLockStats() noexcept;
+C_MyLockStats &tableLockStats() noexcept;
+E_MyErrorKind errorKind(unsigned errNo) noexcept;
 std::string errorSuffix(MYSQL *mysql);
 std::string errorSuffix(MYSQL_STMT *stmt);
+void countRoundTrip(MYSQL *mysql) noexcept;
+void countRoundTrip(C_MyConnCounters *counters) noexcept;
+long long memoryHeld() noexcept;
+unsigned long long roundTrips() noexcept;
 
 void query(MYSQL *mysql, const std::string &sql);
+T_MyExpected<void> tryQuery(MYSQL *mysql, const std::string &sql);
 void affect(MYSQL *mysql, const std::string &sql);
+std::vector<unsigned long long> insertIds(MYSQL *mysql, const std::string &sql, size_t rows);
 void resetDatabase(C_MySQL &mysql, const std::string &db_name, const std::string &bof_db);
 void useDatabase(MYSQL *mysql, const std::string &db_name);
 
 bool isCaseSensitive(MYSQL *mysql);
 std::string queryString(MYSQL *mysql, const std::string &sql, int colInd = 0);
+T_MyExpected<std::string> tryQueryString(MYSQL *mysql, const std::string &sql, int colInd = 0);
 unsigned long queryULong(MYSQL *mysql, const std::string &sql, int colInd = 0);
 void queryColumn(MYSQL *mysql, const std::string &sql, std::function<bool(const char*)> nextRow, int colInd = 0);
 C_MySqlResult query(MYSQL *mysql, const std::string &sql, E_MySqlResultKind kind);
+T_MyExpected<C_MySqlResult> tryQuery(MYSQL *mysql, const std::string &sql, E_MySqlResultKind kind);
+C_MyRowSet queryRows(MYSQL *mysql, const std::string &sql);
+T_MyExpected<C_MyRowSet> tryQueryRows(MYSQL *mysql, const std::string &sql);
+void queryEachRow(MYSQL *mysql, const std::string &sql, std::function<bool(MYSQL_ROW row, const unsigned long *lengths)> nextRow);
+std::string quotedSql(MYSQL *mysql, std::string_view str);
 std::string getTableSchema(MYSQL *mysql, const std::string &db_name, const std::string &table_name);
 
 void bindLongBlob(MYSQL_BIND &dst);
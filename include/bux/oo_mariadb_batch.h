@@ -0,0 +1,368 @@
+﻿#pragma once
+
+/*! \file
+    \brief Batching of lookups by keys
+*/
+
+#include "oo_mariadb.h"     // bux::C_MySQL, bux::C_MySqlStmt, bux::C_MyRowSet
+#include <algorithm>        // std::max(), std::min()
+#include <bit>              // std::bit_ceil()
+#include <chrono>           // std::chrono::microseconds
+#include <condition_variable>   // std::condition_variable_any
+#include <future>           // std::promise<>, std::shared_future<>
+#include <mutex>            // std::mutex
+#include <thread>           // std::jthread
+#include <unordered_map>    // std::unordered_map<>
+
+namespace bux {
+
+//
+//      Types
+//
+template<class T>
+concept MySqlKey = std::integral<T> || std::same_as<T,std::string>;
+
+using T_MyRows = std::vector<std::vector<std::optional<std::string>>>;
+
+template<MySqlKey K>
+class C_MyBatchLoader
+/*! \brief DataLoader-style batcher which turns point lookups by keys into <tt>... IN (?,?,...)</tt> queries.
+
+    Keys requested by load() are deduped and collected until dispatch() is called (end of request scope),
+    until C_Options::m_maxBatch keys are pending, or until C_Options::m_window elapses if it is nonzero.
+    The number of placeholders is rounded up to a power of 2 so that few prepared statements are cached.
+    The connection is used exclusively by the loader once constructed.
+*/
+{
+public:
+
+    // Types
+    struct C_Options
+    {
+        std::chrono::microseconds   m_window{0};    ///< Zero to dispatch by dispatch() or m_maxBatch only
+        size_t                      m_maxBatch{256};
+    };
+
+    // Nonvirtuals
+    C_MyBatchLoader(C_MySQL &mysql, std::string selectPrefix, size_t keyField = 0);
+    C_MyBatchLoader(C_MySQL &mysql, std::string selectPrefix, size_t keyField, const C_Options &opts);
+    ~C_MyBatchLoader();
+    C_MyBatchLoader(const C_MyBatchLoader&) = delete;
+    C_MyBatchLoader &operator=(const C_MyBatchLoader&) = delete;
+    void dispatch();
+    std::shared_future<T_MyRows> load(const K &key);
+
+private:
+
+    // Types
+    struct C_Pending
+    {
+        std::promise<T_MyRows>          m_promise;
+        std::shared_future<T_MyRows>    m_future;
+    };
+    using C_Batch = std::vector<std::pair<K,std::promise<T_MyRows>>>;
+
+    // Data
+    C_MySQL                                         &m_mysql;
+    const std::string                               m_selectPrefix;
+    const size_t                                    m_keyField;
+    const C_Options                                 m_opts;
+    std::mutex                                      m_lock;     // Guards m_pending
+    std::condition_variable_any                     m_cv;
+    std::unordered_map<K,C_Pending>                 m_pending;
+    std::mutex                                      m_connLock; // Guards m_mysql & m_stmts
+    std::unordered_map<size_t,C_MySqlStmt>          m_stmts;    // by number of placeholders
+    unsigned long                                   m_stmtThreadId{};
+    std::jthread                                    m_timer;
+
+    // Nonvirtuals
+    void execute(C_Batch &batch);
+    void fetch(std::pair<K,std::promise<T_MyRows>> *keys, size_t count);
+    C_MySqlStmt &stmtOf(size_t placeholders);
+    C_Batch take();
+};
+
+//
+//      Externs
+//
+void createKeyTable(MYSQL *mysql, const std::string &keyType);
+void setArraySize(MYSQL_STMT *stmt, size_t n);
+
+//
+//      Inlines & Templates
+//
+inline const std::string &keyString(const std::string &key)
+{
+    return key;
+}
+
+template<std::integral T>
+std::string keyString(T key)
+{
+    return std::to_string(key);
+}
+
+template<MySqlKey K>
+void bindKey(MYSQL_BIND &dst, K &key)
+{
+    if constexpr (std::integral<K>)
+        bindInt(dst, key);
+    else
+        bindStrParam(dst, key);
+}
+
+template<MySqlKey K>
+void queryByKeys(MYSQL *mysql, const std::string &selectFrom, const std::string &keyColumn, const std::vector<K> &keys,
+    std::function<bool(MYSQL_ROW row, const unsigned long *lengths)> nextRow, size_t maxInList = 1000)
+/*! \brief Stream rows of \a selectFrom whose \a keyColumn is in \a keys, where keys are either listed by
+    <tt>... WHERE keyColumn IN (...)</tt> or, if there are more than \a maxInList keys, bulk-loaded by array
+    binding into session temporary table <tt>bux_keys(k)</tt> to be joined with.
+    \param [in] mysql Connection on which the temporary table lives
+    \param [in] selectFrom e.g. <tt>"select u.id,u.name from users u"</tt> without WHERE clause
+    \param [in] keyColumn e.g. <tt>"u.id"</tt>
+    \param [in] keys Keys to look up, duplicates allowed
+    \param [in] nextRow Called per row until returning false
+    \param [in] maxInList Maximum number of keys to be listed by IN
+*/
+{
+    if (keys.empty())
+        return;
+
+    if (keys.size() <= maxInList)
+    {
+        auto sql = selectFrom + " where " + keyColumn + " in (";
+        for (auto &i: keys)
+        {
+            if constexpr (std::integral<K>)
+                sql += std::to_string(i);
+            else
+                sql += quotedSql(mysql, i);
+
+            sql += ',';
+        }
+        sql.back() = ')';
+        return queryEachRow(mysql, sql, std::move(nextRow));
+    }
+
+    if constexpr (std::integral<K>)
+        createKeyTable(mysql, std::numeric_limits<K>::is_signed? "bigint": "bigint unsigned");
+    else
+        createKeyTable(mysql, "varchar(255)");
+
+    constexpr size_t KEYS_PER_EXEC = 4096;
+    C_MySqlStmt stmt(mysql);
+    stmt.prepare("insert ignore into bux_keys values (?)");
+    std::vector<std::conditional_t<std::integral<K>,long long,const char*>> values;
+    std::vector<unsigned long> lengths;
+    for (size_t off = 0; off < keys.size(); off += KEYS_PER_EXEC)
+    {
+        const auto n = std::min(KEYS_PER_EXEC, keys.size() - off);
+        values.clear();
+        lengths.clear();
+        for (size_t i = off; i < off + n; ++i)
+            if constexpr (std::integral<K>)
+                values.emplace_back(static_cast<long long>(keys[i]));
+            else
+            {
+                values.emplace_back(keys[i].data());
+                lengths.emplace_back(static_cast<unsigned long>(keys[i].size()));
+            }
+
+        setArraySize(stmt, n);
+        stmt.bindParams([&](MYSQL_BIND *barr) {
+            // Column-wise array binding
+            barr->buffer = values.data();
+            if constexpr (std::integral<K>)
+            {
+                barr->buffer_type = MYSQL_TYPE_LONGLONG;
+                barr->is_unsigned = !std::numeric_limits<K>::is_signed;
+            }
+            else
+            {
+                barr->buffer_type = MYSQL_TYPE_STRING;
+                barr->length = lengths.data();
+            }
+        });
+        stmt.exec();
+    }
+    setArraySize(stmt, 0);
+    queryEachRow(mysql, selectFrom + " join bux_keys on " + keyColumn + "=bux_keys.k", std::move(nextRow));
+}
+
+//
+//      Implement Class Templates
+//
+template<MySqlKey K>
+C_MyBatchLoader<K>::C_MyBatchLoader(C_MySQL &mysql, std::string selectPrefix, size_t keyField):
+    C_MyBatchLoader(mysql, std::move(selectPrefix), keyField, C_Options{})
+{
+}
+
+/*! \param [in] mysql Connection to be used by the loader exclusively
+    \param [in] selectPrefix e.g. <tt>"select id,name from users where id"</tt> to which <tt>" in (?,...)"</tt> is appended
+    \param [in] keyField Index of the result column equal to the key, to distribute rows back to callers
+    \param [in] opts Batching options
+*/
+template<MySqlKey K>
+C_MyBatchLoader<K>::C_MyBatchLoader(C_MySQL &mysql, std::string selectPrefix, size_t keyField, const C_Options &opts):
+    m_mysql(mysql),
+    m_selectPrefix(std::move(selectPrefix)),
+    m_keyField(keyField),
+    m_opts{opts.m_window, std::max<size_t>(opts.m_maxBatch, 1)}
+{
+    if (m_opts.m_window.count())
+        m_timer = std::jthread([this](std::stop_token stop) {
+            std::unique_lock lk{m_lock};
+            while (m_cv.wait(lk, stop, [this]{ return !m_pending.empty(); }))
+            {
+                // Collect more keys for the window
+                m_cv.wait_for(lk, stop, m_opts.m_window, []{ return false; });
+                auto batch = take();
+                lk.unlock();
+                execute(batch);
+                lk.lock();
+            }
+        });
+}
+
+template<MySqlKey K>
+C_MyBatchLoader<K>::~C_MyBatchLoader()
+{
+    if (m_timer.joinable())
+    {
+        m_timer.request_stop();
+        m_timer.join();
+    }
+    dispatch();
+}
+
+template<MySqlKey K>
+void C_MyBatchLoader<K>::dispatch()
+{
+    C_Batch batch;
+    {
+        std::lock_guard _{m_lock};
+        batch = take();
+    }
+    execute(batch);
+}
+
+template<MySqlKey K>
+void C_MyBatchLoader<K>::execute(C_Batch &batch)
+{
+    if (batch.empty())
+        return;
+
+    std::lock_guard _{m_connLock};
+    for (size_t i = 0; i < batch.size(); i += m_opts.m_maxBatch)
+        fetch(batch.data() + i, std::min(m_opts.m_maxBatch, batch.size() - i));
+}
+
+template<MySqlKey K>
+void C_MyBatchLoader<K>::fetch(std::pair<K,std::promise<T_MyRows>> *keys, size_t count)
+{
+    try
+    {
+        const auto placeholders = std::min(std::bit_ceil(count), m_opts.m_maxBatch);
+        auto &stmt = stmtOf(placeholders);
+        std::vector<K> params;
+        params.reserve(placeholders);
+        for (size_t i = 0; i < count; ++i)
+            params.emplace_back(keys[i].first);
+
+        params.resize(placeholders, keys[count-1].first); // Pad with the last key
+        stmt.bindParams([&](MYSQL_BIND *barr) {
+            for (size_t i = 0; i < placeholders; ++i)
+                bindKey(barr[i], params[i]);
+        });
+        auto rows = stmt.execFetchRows();
+        std::unordered_map<std::string,T_MyRows> byKey;
+        for (auto &i: rows.m_rows)
+            if (m_keyField < i.size() && i[m_keyField])
+            {
+                auto key = *i[m_keyField];
+                byKey[std::move(key)].emplace_back(std::move(i));
+            }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            T_MyRows dst;
+            if (auto found = byKey.find(keyString(keys[i].first)); found != byKey.end())
+                dst = std::move(found->second);
+
+            keys[i].second.set_value(std::move(dst));
+        }
+    }
+    catch (...)
+    {
+        for (size_t i = 0; i < count; ++i)
+            try
+            {
+                keys[i].second.set_exception(std::current_exception());
+            }
+            catch (const std::future_error&)
+            {
+                // Already satisfied
+            }
+    }
+}
+
+template<MySqlKey K>
+std::shared_future<T_MyRows> C_MyBatchLoader<K>::load(const K &key)
+/*! \return Future of all rows whose C_MyBatchLoader::m_keyField column equals \a key byte-wise
+*/
+{
+    std::shared_future<T_MyRows> ret;
+    C_Batch batch;
+    {
+        std::lock_guard _{m_lock};
+        auto &slot = m_pending[key];
+        if (!slot.m_future.valid())
+            slot.m_future = slot.m_promise.get_future().share();
+
+        ret = slot.m_future;
+        if (m_pending.size() >= m_opts.m_maxBatch)
+            batch = take();
+        else if (m_pending.size() == 1)
+            m_cv.notify_one();
+    }
+    execute(batch);
+    return ret;
+}
+
+template<MySqlKey K>
+C_MySqlStmt &C_MyBatchLoader<K>::stmtOf(size_t placeholders)
+{
+    MYSQL *const mysql = m_mysql.mysql();
+    if (const auto tid = m_mysql.threadId(); tid != m_stmtThreadId)
+    {
+        // Reconnected
+        m_stmts.clear();
+        m_stmtThreadId = tid;
+    }
+    if (const auto found = m_stmts.find(placeholders); found != m_stmts.end())
+        return found->second;
+
+    auto sql = m_selectPrefix + " in (?";
+    for (size_t i = 1; i < placeholders; ++i)
+        sql += ",?";
+
+    sql += ')';
+    C_MySqlStmt stmt{mysql};
+    stmt.prepare(sql);
+    return m_stmts.try_emplace(placeholders, std::move(stmt)).first->second;
+}
+
+template<MySqlKey K>
+auto C_MyBatchLoader<K>::take() -> C_Batch
+{
+    C_Batch ret;
+    ret.reserve(m_pending.size());
+    for (auto &i: m_pending)
+        ret.emplace_back(i.first, std::move(i.second.m_promise));
+
+    m_pending.clear();
+    return ret;
+}
+
+} // namespace bux
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+/*! \file
+    \brief Binlog-driven invalidation of bux::C_MyQueryCache, requiring MariaDB Connector/C 3.1+
+*/
+
+#include "oo_mariadb.h"     // bux::C_MySQL
+#include <atomic>           // std::atomic<>
+#include <mutex>            // std::mutex
+#include <stop_token>       // std::stop_token
+#include <thread>           // std::jthread
+
+namespace bux {
+
+//
+//      Types
+//
+class C_MyBinlogInvalidator
+/*! \brief Tail the binlog of a server on a background thread and invalidate all live C_MyQueryCache instances
+    by tables changed by any client of the server, so that cached results can live without TTL.
+
+    The login user needs the REPLICATION SLAVE privilege and the server must have log_bin enabled. Caches are
+    fully invalidated whenever tailing (re)starts, because events in between are unknown. The destructor stops
+    tailing promptly by shutting down the socket of the tailing connection.
+*/
+{
+public:
+
+    // Nonvirtuals
+    explicit C_MyBinlogInvalidator(const C_MySQL &connProto, unsigned serverId = 0x4275780);
+    ~C_MyBinlogInvalidator();
+    C_MyBinlogInvalidator(const C_MyBinlogInvalidator&) = delete;
+    C_MyBinlogInvalidator &operator=(const C_MyBinlogInvalidator&) = delete;
+    auto events() const { return m_events.load(); }
+    std::string lastError() const;
+
+private:
+
+    // Data
+    C_MySQL                         m_tail;
+    const unsigned                  m_serverId;
+    std::mutex                      m_socketLock;
+    my_socket                       m_tailSocket{};     // Of m_tail while connected, guarded by m_socketLock
+    bool                            m_tailing{};        // m_tailSocket is valid, guarded by m_socketLock
+    std::atomic<size_t>             m_events{};
+    std::atomic<bool>               m_done{};
+    mutable std::mutex              m_errorLock;
+    std::string                     m_lastError;
+    std::jthread                    m_thread;
+
+    // Nonvirtuals
+    void run(std::stop_token stop);
+    bool setTailing(MYSQL *mysql, std::stop_token stop);
+    void shutdownTail();
+    void tail(std::stop_token stop);
+};
+
+} // namespace bux
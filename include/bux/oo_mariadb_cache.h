@@ -0,0 +1,132 @@
+﻿#pragma once
+
+/*! \file
+    \brief Opt-in client-side cache of materialized query results
+*/
+
+#include "oo_mariadb.h"     // bux::C_MyRowSet, bux::C_MySqlStmt
+#include <atomic>           // std::atomic<>
+#include <chrono>           // std::chrono::steady_clock
+#include <future>           // std::shared_future<>
+#include <list>             // std::list<>
+#include <mutex>            // std::mutex
+#include <string_view>      // std::string_view
+#include <unordered_map>    // std::unordered_map<>
+#include <unordered_set>    // std::unordered_set<>
+
+namespace bux {
+
+//
+//      Types
+//
+class C_MySingleFlight
+/*! \brief Coalesce concurrent identical reads, each issued through its own connection, into one execution
+    whose materialized result is shared by all callers.
+
+    A read issued through a connection inside a transaction runs on its own and is never shared, because it
+    may see rows that transaction has not committed.
+*/
+{
+public:
+
+    // Nonvirtuals
+    C_MySingleFlight() = default;
+    C_MySingleFlight(const C_MySingleFlight&) = delete;
+    C_MySingleFlight &operator=(const C_MySingleFlight&) = delete;
+    auto coalesced() const { return m_coalesced.load(); }
+    std::shared_ptr<const C_MyRowSet> query(MYSQL *mysql, const std::string &sql);
+    std::shared_ptr<const C_MyRowSet> query(C_MySqlStmt &stmt, const std::string &sql,
+        const std::function<void(MYSQL_BIND *barr)> &binder);
+    std::shared_ptr<const C_MyRowSet> run(const std::string &key,
+        const std::function<std::shared_ptr<const C_MyRowSet>()> &fetch);
+
+private:
+
+    // Data
+    std::mutex                                                                          m_lock;
+    std::unordered_map<std::string,std::shared_future<std::shared_ptr<const C_MyRowSet>>> m_inflight;
+    std::atomic<size_t>                                                                 m_coalesced{};
+};
+
+class C_MyQueryCache
+/*! \brief Thread-safe LRU cache of read results, keyed by the default database, normalized SQL plus bound
+    parameter values.
+
+    Every live instance is invalidated by table names whenever a write statement succeeds through
+    bux::query() or bux::C_MySqlStmt::exec() in the same process, and again when the writing thread commits.
+    Writes made by other processes are not seen: bound the staleness with C_Options::m_ttl or feed another
+    invalidation source into invalidate().
+
+    Only tables named in the SQL text of a write are invalidated, so rows changed behind the scenes by views,
+    triggers or foreign key cascades stay cached until they expire. Reads through a connection inside a
+    transaction bypass the cache in both directions.
+*/
+{
+public:
+
+    // Types
+    struct C_Options
+    {
+        std::chrono::milliseconds   m_ttl{std::chrono::minutes{1}}; ///< Zero for no expiry
+        size_t                      m_maxEntries{1024};
+        size_t                      m_maxBytes{64<<20};             ///< Approximate bytes of all cached row sets
+    };
+    struct C_Stats
+    {
+        size_t  m_hits, m_misses, m_entries, m_bytes;
+    };
+
+    // Nonvirtuals
+    C_MyQueryCache();
+    explicit C_MyQueryCache(const C_Options &opts);
+    ~C_MyQueryCache();
+    C_MyQueryCache(const C_MyQueryCache&) = delete;
+    C_MyQueryCache &operator=(const C_MyQueryCache&) = delete;
+    void invalidate(std::string_view table);
+    void invalidateAll();
+    std::shared_ptr<const C_MyRowSet> query(MYSQL *mysql, const std::string &sql);
+    std::shared_ptr<const C_MyRowSet> query(C_MySqlStmt &stmt, const std::string &sql,
+        const std::function<void(MYSQL_BIND *barr)> &binder);
+    C_Stats stats() const;
+
+private:
+
+    // Types
+    struct C_Entry
+    {
+        std::shared_ptr<const C_MyRowSet>       m_rows;
+        std::chrono::steady_clock::time_point   m_expiry;
+        size_t                                  m_bytes;
+        std::vector<std::string>                m_tables;
+        std::list<std::string>::iterator        m_lru;
+    };
+
+    // Data
+    const C_Options                                                 m_opts;
+    mutable std::mutex                                              m_lock;
+    std::unordered_map<std::string,C_Entry>                         m_entries;
+    std::unordered_map<std::string,std::unordered_set<std::string>> m_byTable;
+    std::list<std::string>                                          m_lru; // Most recently used first
+    size_t                                                          m_bytes{};
+    size_t                                                          m_generation{}; // Bumped by every invalidation
+    size_t                                                          m_epoch;        // Of invalidateAllCaches() last applied
+    std::atomic<size_t>                                             m_hits{}, m_misses{};
+    C_MySingleFlight                                                m_flight; // Against stampedes on misses
+
+    // Nonvirtuals
+    void erase(std::unordered_map<std::string,C_Entry>::iterator it);
+    std::shared_ptr<const C_MyRowSet> find(const std::string &key);
+    size_t generation() const;
+    void insert(const std::string &key, std::string_view sql, std::shared_ptr<const C_MyRowSet> rows, size_t generation);
+    void syncEpoch();
+};
+
+//
+//      Externs
+//
+std::string cacheKey(std::string_view db, std::string_view sql, const MYSQL_BIND *params, size_t count);
+void invalidateAllCaches() noexcept;
+void invalidateCaches(std::string_view table);
+void notifyWriteSql(std::string_view sql) noexcept;
+
+} // namespace bux
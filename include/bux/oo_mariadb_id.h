@@ -0,0 +1,82 @@
+﻿#pragma once
+
+/*! \file
+    \brief Hi-lo allocation of unique ids by blocks, without per-insert round trips
+*/
+
+#include "oo_mariadb.h"     // bux::C_MySQL
+#include <atomic>           // std::atomic<>
+#include <condition_variable>   // std::condition_variable_any
+#include <cstdint>          // uint64_t
+#include <mutex>            // std::mutex
+#include <stop_token>       // std::stop_token
+#include <thread>           // std::jthread
+
+namespace bux {
+
+//
+//      Types
+//
+enum E_MyIdSource
+/// \brief Where blocks of ids are reserved from
+{
+    MYID_SEQUENCE,  ///< MariaDB 10.3+ SEQUENCE object; <tt>nextval()</tt> times block size is the block base
+    MYID_TABLE      ///< Single-row table of column <tt>next_id</tt> which is advanced by block size
+};
+
+class C_MyIdAllocator
+/*! \brief Hand out unique ids lock-free from blocks reserved by one statement each.
+
+    A background thread keeps C_Options::m_prefetch blocks ahead of the one being consumed, so next()
+    normally costs one atomic increment. Ids are unique across processes sharing the same source but are
+    neither gapless nor ordered across threads; unused ids of reserved blocks are lost on destruction.
+*/
+{
+public:
+
+    // Types
+    struct C_Options
+    {
+        uint64_t    m_blockSize{1000};
+        size_t      m_prefetch{1};  ///< Number of blocks reserved ahead
+    };
+
+    // Nonvirtuals
+    C_MyIdAllocator(const C_MySQL &connProto, E_MyIdSource source, std::string name);
+    C_MyIdAllocator(const C_MySQL &connProto, E_MyIdSource source, std::string name, const C_Options &opts);
+    ~C_MyIdAllocator();
+    C_MyIdAllocator(const C_MyIdAllocator&) = delete;
+    C_MyIdAllocator &operator=(const C_MyIdAllocator&) = delete;
+    uint64_t next();
+
+private:
+
+    // Types
+    struct C_Slot
+    {
+        std::atomic<uint64_t>   m_block{0}; ///< Block index plus 1, or 0 while being written
+        std::atomic<uint64_t>   m_base{0};  ///< First id of the block
+    };
+
+    // Data
+    C_MySQL                         m_mysql;
+    const E_MyIdSource              m_source;
+    const std::string               m_name;
+    const C_Options                 m_opts;
+    const size_t                    m_ringSize;
+    const std::unique_ptr<C_Slot[]> m_ring;
+    std::atomic<uint64_t>           m_ticket{0};
+    std::mutex                      m_lock;     // Guards data below
+    std::condition_variable_any     m_cv;
+    uint64_t                        m_filled{0};    // Number of blocks reserved so far
+    size_t                          m_failures{0};
+    std::string                     m_lastError;
+    std::jthread                    m_refiller;
+
+    // Nonvirtuals
+    uint64_t reserveBlock();
+    void refill(std::stop_token stop);
+    bool waitBlock(uint64_t block);
+};
+
+} // namespace bux
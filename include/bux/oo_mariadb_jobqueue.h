@@ -0,0 +1,84 @@
+﻿#pragma once
+
+/*! \file
+    \brief Database-backed job queue consumer by <tt>SELECT ... FOR UPDATE SKIP LOCKED</tt> (MariaDB 10.6+)
+*/
+
+#include "oo_mariadb.h"     // bux::C_MySQL
+#include <chrono>           // std::chrono::milliseconds
+#include <functional>       // std::function<>
+#include <mutex>            // std::mutex
+#include <stop_token>       // std::stop_token
+
+namespace bux {
+
+//
+//      Types
+//
+struct C_MyJob
+{
+    unsigned long long                          m_id;
+    std::vector<std::optional<std::string>>     m_fields;   ///< Values of C_MyJobQueue::C_Schema::m_fields
+};
+
+class C_MyJobQueue
+/*! \brief Claim batches of ready jobs without blocking other consumers, hand them to worker threads,
+    and acknowledge completions in batches.
+
+    A claim is one short transaction of two round trips: <tt>START TRANSACTION; SELECT ... FOR UPDATE SKIP LOCKED</tt>
+    followed by <tt>UPDATE ... SET state=claimed; COMMIT</tt>. Jobs left claimed by a crashed consumer are
+    not reclaimed here.
+
+    With C_Schema::m_attemptsColumn set, every claim counts an attempt and a job nacked after
+    C_Options::m_maxAttempts attempts turns C_Schema::m_dead instead of ready, so that a poison job is not
+    retried forever.
+*/
+{
+public:
+
+    // Types
+    struct C_Schema
+    {
+        std::string     m_table;
+        std::string     m_idColumn{"id"};
+        std::string     m_stateColumn{"state"};
+        std::string     m_fields;   ///< Comma-separated columns to fetch along with id, e.g. "kind,payload"
+        std::string     m_attemptsColumn;   ///< Integer column counting claims, or empty for unlimited retries
+        int             m_ready{0}, m_claimed{1}, m_done{2}, m_dead{3};
+    };
+    struct C_Options
+    {
+        size_t                      m_minBatch{1}, m_maxBatch{256};
+        size_t                      m_ackBatch{256};
+        std::chrono::milliseconds   m_ackInterval{100};
+        std::chrono::milliseconds   m_idleWait{100};    ///< Sleep after claiming nothing
+        unsigned                    m_maxAttempts{5};   ///< Used only with C_Schema::m_attemptsColumn
+    };
+    using F_Handler = std::function<void(const C_MyJob &job)>;
+
+    // Nonvirtuals
+    C_MyJobQueue(const C_MySQL &connProto, C_Schema schema);
+    C_MyJobQueue(const C_MySQL &connProto, C_Schema schema, const C_Options &opts);
+    C_MyJobQueue(const C_MyJobQueue&) = delete;
+    C_MyJobQueue &operator=(const C_MyJobQueue&) = delete;
+    void ack(unsigned long long id);
+    std::vector<C_MyJob> claim(size_t max);
+    void flushAcks();
+    void nack(unsigned long long id);
+    void run(size_t workers, const F_Handler &handler, std::stop_token stop);
+
+private:
+
+    // Data
+    C_MySQL                         m_mysql;
+    const C_Schema                  m_schema;
+    const C_Options                 m_opts;
+    std::mutex                      m_connLock; // Guards m_mysql
+    std::mutex                      m_ackLock;  // Guards data below
+    std::vector<unsigned long long> m_acks, m_nacks;
+
+    // Nonvirtuals
+    std::string setState(const std::string &assignments, const std::vector<unsigned long long> &ids) const;
+};
+
+} // namespace bux
@@ -0,0 +1,169 @@
+﻿#pragma once
+
+/*! \file
+    \brief Per-operation observer hooks and lock-free latency histograms
+
+    Define <tt>BUX_MY_NO_OBSERVERS</tt> when building the library to compile all hooks out.
+*/
+
+#include <mysql/mysql.h>    // MYSQL, MYSQL_BIND
+#include <atomic>           // std::atomic<>
+#include <chrono>           // std::chrono::steady_clock
+#include <cstdint>          // uint64_t
+#include <memory>           // std::unique_ptr<>
+#include <shared_mutex>     // std::shared_mutex
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+#include <unordered_map>    // std::unordered_map<>
+#include <vector>           // std::vector<>
+
+namespace bux {
+
+//
+//      Types
+//
+enum E_MyOp
+{
+    MYOP_CONNECT,   ///< C_MySQL::connect_()
+    MYOP_QUERY,     ///< query()
+    MYOP_STORE,     ///< mysql_store_result() or mysql_use_result() by query() returning C_MySqlResult
+    MYOP_PREPARE,   ///< C_MySqlStmt::prepare()
+    MYOP_BIND,      ///< C_MySqlStmt::bindParams(), including long data sent
+    MYOP_EXEC,      ///< C_MySqlStmt::execNoThrow() and its callers
+    MYOP_FETCH      ///< C_MySqlStmt::nextRow()
+};
+
+struct C_MyOpEvent
+/// \brief What an operation did and how long it took
+{
+    E_MyOp                                  m_op;
+    std::string_view                        m_sql;          ///< Empty for MYOP_CONNECT
+    MYSQL                                   *m_mysql{};
+    std::chrono::steady_clock::time_point   m_start;
+    std::chrono::steady_clock::duration     m_elapsed{};
+    unsigned long long                      m_rows{};       ///< Rows affected by a write, or fetched
+    unsigned long long                      m_bytes{};      ///< SQL text sent, or column data fetched
+    unsigned                                m_retries{};    ///< Retries on deadlock or lock wait timeout
+    unsigned                                m_errno{};      ///< 0 on success
+    const MYSQL_BIND                        *m_params{};    ///< Bound parameters of MYOP_EXEC, if any
+    size_t                                  m_paramCount{};
+};
+
+class I_MyObserver
+/// \brief Receiver of C_MyOpEvent's from all connections, called in the thread doing the operation
+{
+public:
+
+    // Nonvirtuals
+    virtual ~I_MyObserver() = default;
+
+    // Virtuals
+    virtual void onOp(const C_MyOpEvent &ev) noexcept = 0;
+};
+
+class C_MyCallSite
+/*! \brief Tag the operations issued by the current thread during the lifetime, for observers to tell call sites apart.
+
+    Tags nest and the innermost wins. \a tag must outlive all observers, e.g. a string literal.
+*/
+{
+public:
+
+    // Nonvirtuals
+    explicit C_MyCallSite(const char *tag) noexcept;
+    ~C_MyCallSite();
+    C_MyCallSite(const C_MyCallSite &) = delete;
+    C_MyCallSite &operator=(const C_MyCallSite &) = delete;
+    static const char *current() noexcept;
+
+private:
+
+    // Data
+    const char *const m_outer;
+};
+
+class C_MyHistogram
+/*! \brief Lock-free log-linear histogram of nanoseconds, HDR-style:
+    16 sub-buckets per power of 2 bound the relative error of percentiles under 1/16.
+*/
+{
+public:
+
+    // Nonvirtuals
+    uint64_t count() const noexcept { return m_count.load(std::memory_order_relaxed); }
+    uint64_t max() const noexcept { return m_max.load(std::memory_order_relaxed); }
+    uint64_t percentile(double p) const noexcept;
+    void record(uint64_t ns) noexcept;
+    void reset() noexcept;
+    uint64_t sum() const noexcept { return m_sum.load(std::memory_order_relaxed); }
+
+private:
+
+    // Types
+    enum
+    {
+        SUB_BITS    = 4,
+        SUB_COUNT   = 1 << SUB_BITS,
+        BUCKETS     = (64 - SUB_BITS + 1) * SUB_COUNT
+    };
+
+    // Data
+    std::atomic<uint64_t>   m_buckets[BUCKETS]{};
+    std::atomic<uint64_t>   m_count{}, m_sum{}, m_max{};
+
+    // Nonvirtuals
+    static unsigned bucketOf(uint64_t ns) noexcept;
+    static uint64_t lowerBound(unsigned bucket) noexcept;
+};
+
+class C_MyLatencyByFingerprint: public I_MyObserver
+/*! \brief Latency histogram per statement fingerprint (see fingerprintSql()) of MYOP_QUERY and MYOP_EXEC.
+
+    Fingerprints beyond \a maxFingerprints are all counted as one with empty fingerprint.
+*/
+{
+public:
+
+    // Types
+    struct C_Summary
+    {
+        std::string     m_fingerprint;
+        uint64_t        m_count, m_errors, m_totalNs, m_p50Ns, m_p99Ns, m_maxNs;
+    };
+
+    // Nonvirtuals
+    explicit C_MyLatencyByFingerprint(size_t maxFingerprints = 1000): m_maxFingerprints(maxFingerprints) {}
+    void reset();
+    std::vector<C_Summary> summary() const;
+
+    // Implement I_MyObserver
+    void onOp(const C_MyOpEvent &ev) noexcept override;
+
+private:
+
+    // Types
+    struct C_Entry
+    {
+        C_MyHistogram           m_latency;
+        std::atomic<uint64_t>   m_errors{};
+    };
+
+    // Data
+    const size_t                        m_maxFingerprints;
+    mutable std::shared_mutex           m_lock;     // Guards m_entries but not their content
+    std::unordered_map<std::string,std::unique_ptr<C_Entry>> m_entries;
+};
+
+//
+//      Externs
+//
+void addObserver(I_MyObserver &obs);
+void notifyOp(const C_MyOpEvent &ev) noexcept;
+void removeObserver(I_MyObserver &obs) noexcept;
+#ifdef BUX_MY_NO_OBSERVERS
+constexpr bool observing() noexcept { return false; }
+#else
+bool observing() noexcept;
+#endif
+
+} // namespace bux
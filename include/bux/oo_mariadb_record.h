@@ -0,0 +1,120 @@
+﻿#pragma once
+
+/*! \file
+    \brief Recording of queries and statement executions into a compact binary trace, and reading it back for replay
+
+    The trace file starts with the 8-byte magic <tt>BUXMYTR1</tt>, followed by records of:
+    - \c u8 tag: E_MyOp of the record, ORed with 0x80 if a new SQL text follows
+    - varints: start in nanoseconds since the recorder is constructed, elapsed nanoseconds, connection id, errno, SQL id
+    - if tagged, varint byte count and bytes of the SQL text, whose id is the number of SQL texts preceding it
+    - varint parameter count, and for each parameter: \c u8 <tt>enum_field_types</tt>, \c u8 flags (1 for NULL,
+      2 for unsigned), varint byte count and raw bytes of the bound buffer in host byte order
+
+    Varints are unsigned LEB128.
+*/
+
+#include "oo_mariadb_observe.h" // bux::I_MyObserver
+#include <chrono>           // std::chrono::milliseconds
+#include <condition_variable>   // std::condition_variable_any
+#include <deque>            // std::deque<>
+#include <fstream>          // std::ifstream, std::ofstream
+#include <functional>       // std::equal_to<>, std::hash<>
+#include <mutex>            // std::mutex
+#include <stop_token>       // std::stop_token
+#include <thread>           // std::jthread
+#include <unordered_map>    // std::unordered_map<>
+
+namespace bux {
+
+//
+//      Types
+//
+struct C_MyTraceRecord
+/// \brief One query or statement execution read by C_MyTraceReader
+{
+    struct C_Param
+    {
+        enum_field_types    m_type;
+        bool                m_null, m_unsigned;
+        std::string         m_bytes;
+    };
+
+    E_MyOp                  m_op;       ///< MYOP_QUERY or MYOP_EXEC
+    uint64_t                m_startNs, m_elapsedNs, m_connId, m_sqlId;
+    unsigned                m_errno;
+    const std::string       *m_sql;     ///< Owned by the reader
+    std::vector<C_Param>    m_params;
+};
+
+class C_MyTraceRecorder: public I_MyObserver
+/*! \brief Record SQL text, bound parameters, timing, connection id and errno of every query and statement execution
+    into a trace file, to be replayed by <tt>bux-mariadb-replay</tt>.
+
+    SQL texts are interned so that a prepared statement costs its text only once. Records are appended to a buffer
+    under a mutex and written to file by a background thread; those finding the buffer full are dropped and
+    counted by dropped(). Register it by addObserver() and remove it by removeObserver() before destruction.
+*/
+{
+public:
+
+    // Types
+    struct C_Options
+    {
+        std::chrono::milliseconds   m_flushInterval{200};
+        size_t                      m_maxBuffered{64 << 20};    ///< Bytes buffered before records are dropped
+    };
+
+    // Nonvirtuals
+    explicit C_MyTraceRecorder(std::string path);
+    C_MyTraceRecorder(std::string path, const C_Options &opts);
+    ~C_MyTraceRecorder();
+    C_MyTraceRecorder(const C_MyTraceRecorder&) = delete;
+    C_MyTraceRecorder &operator=(const C_MyTraceRecorder&) = delete;
+    auto dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // Implement I_MyObserver
+    void onOp(const C_MyOpEvent &ev) noexcept override;
+
+private:
+
+    // Types
+    struct C_SqlHash
+    /// \brief Let m_sqlIds be looked up by std::string_view without a copy
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view sql) const noexcept { return std::hash<std::string_view>{}(sql); }
+    };
+
+    // Data
+    const std::string               m_path;
+    const C_Options                 m_opts;
+    const std::chrono::steady_clock::time_point m_base;
+    std::ofstream                   m_out;          // Written by m_writer once constructed
+    std::mutex                      m_lock;         // Guards m_buffer & m_sqlIds
+    std::string                     m_buffer;
+    std::unordered_map<std::string,uint64_t,C_SqlHash,std::equal_to<>> m_sqlIds;
+    std::atomic<uint64_t>           m_dropped{};
+    std::jthread                    m_writer;
+
+    // Nonvirtuals
+    void writeBuffered(std::stop_token stop);
+};
+
+class C_MyTraceReader
+/// \brief Read records of a trace file written by C_MyTraceRecorder one by one
+{
+public:
+
+    // Nonvirtuals
+    explicit C_MyTraceReader(const std::string &path);
+    bool next(C_MyTraceRecord &rec);
+    auto &sqls() const { return m_sqls; }
+
+private:
+
+    // Data
+    std::ifstream               m_in;
+    std::deque<std::string>     m_sqls;     // by SQL id, stable in address
+};
+
+} // namespace bux
@@ -0,0 +1,116 @@
+﻿#pragma once
+
+/*! \file
+    \brief Client-side slow-query log aggregated by SQL fingerprint and call site
+*/
+
+#include "oo_mariadb.h"     // bux::C_MySQL
+#include "oo_mariadb_observe.h" // bux::I_MyObserver
+#include <chrono>           // std::chrono::milliseconds, std::chrono::seconds
+#include <condition_variable>   // std::condition_variable_any
+#include <deque>            // std::deque<>
+#include <map>              // std::map<>
+#include <mutex>            // std::mutex
+#include <optional>         // std::optional<>
+#include <stop_token>       // std::stop_token
+#include <thread>           // std::jthread
+
+namespace bux {
+
+//
+//      Types
+//
+class C_MySlowQueryLog: public I_MyObserver
+/*! \brief Aggregate queries and executes slower than a threshold by (fingerprintSql(), C_MyCallSite::current())
+    in a fixed-size lock-free hash table, and periodically rewrite a file with the top N by total time.
+
+    Register it by addObserver() and remove it by removeObserver() before destruction.
+    New keys are dropped, and counted by dropped(), once the table is nearly full.
+
+    If constructed with a connection prototype, a sampled and rate-limited fraction of the slow statements,
+    with their bound parameters inlined, are explained on a side connection by <tt>EXPLAIN FORMAT=JSON</tt>,
+    or by <tt>ANALYZE FORMAT=JSON</tt> for reads if C_Options::m_analyze is set. The latest plan of each
+    entry is kept in C_Entry::m_plan.
+*/
+{
+public:
+
+    // Types
+    struct C_Options
+    {
+        std::chrono::milliseconds   m_threshold{100};
+        size_t                      m_topN{50};
+        size_t                      m_capacity{4096};   ///< Rounded up to a power of 2
+        std::chrono::seconds        m_interval{60};     ///< Period of dumping to file
+        unsigned                    m_explainEvery{1};  ///< Explain one out of so many slow statements
+        unsigned                    m_explainPerMinute{6};
+        bool                        m_analyze{false};   ///< ANALYZE also executes the statement
+    };
+    struct C_Entry
+    {
+        std::string     m_fingerprint;
+        const char      *m_callSite;
+        uint64_t        m_count, m_errors, m_totalNs, m_maxNs;
+        std::string     m_plan;     ///< Empty if not explained
+    };
+
+    // Nonvirtuals
+    explicit C_MySlowQueryLog(std::string path);
+    C_MySlowQueryLog(std::string path, const C_Options &opts);
+    C_MySlowQueryLog(std::string path, const C_Options &opts, const C_MySQL &explainConnProto);
+    ~C_MySlowQueryLog();
+    C_MySlowQueryLog(const C_MySlowQueryLog&) = delete;
+    C_MySlowQueryLog &operator=(const C_MySlowQueryLog&) = delete;
+    auto dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    void dump() const;
+    std::vector<C_Entry> top(size_t n) const;
+
+    // Implement I_MyObserver
+    void onOp(const C_MyOpEvent &ev) noexcept override;
+
+private:
+
+    // Types
+    enum
+    {
+        FINGERPRINT_MAX = 255,  // Longer ones are truncated
+        MAX_PROBES      = 32
+    };
+    struct C_Slot
+    {
+        std::atomic<uint64_t>   m_hash{};       // 0 if vacant
+        std::atomic<bool>       m_ready{};      // m_callSite & m_fingerprint are written
+        std::atomic<uint64_t>   m_count{}, m_errors{}, m_totalNs{}, m_maxNs{};
+        const char              *m_callSite{};
+        char                    m_fingerprint[FINGERPRINT_MAX + 1]{};
+    };
+    struct C_ExplainJob
+    {
+        uint64_t        m_hash{};
+        std::string     m_sql;
+    };
+
+    // Data
+    const std::string               m_path;
+    const C_Options                 m_opts;
+    const size_t                    m_mask;
+    const std::unique_ptr<C_Slot[]> m_slots;
+    std::atomic<uint64_t>           m_dropped{};
+    std::atomic<uint64_t>           m_slowCount{};
+    std::optional<C_MySQL>          m_explainConn;
+    std::mutex                      m_explainLock;  // Guards m_explainJobs and the token bucket
+    std::condition_variable_any     m_explainCV;
+    std::deque<C_ExplainJob>        m_explainJobs;
+    double                          m_explainTokens{};
+    std::chrono::steady_clock::time_point m_explainRefilled;
+    mutable std::mutex              m_planLock;
+    std::map<uint64_t,std::string>  m_plans;        // Guarded by m_planLock
+    std::jthread                    m_dumper, m_explainer;
+
+    // Nonvirtuals
+    C_MySlowQueryLog(std::string path, const C_Options &opts, std::optional<C_MySQL> explainConn);
+    void explain(std::stop_token stop);
+    void requestExplain(const C_MyOpEvent &ev, uint64_t hash);
+};
+
+} // namespace bux
@@ -0,0 +1,25 @@
+﻿#pragma once
+
+/*! \file
+    \brief Lightweight SQL text utilities shared by caching and instrumentation helpers
+*/
+
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector<>
+
+namespace bux {
+
+//
+//      Externs
+//
+size_t countSqlPlaceholders(std::string_view sql);
+std::string fingerprintSql(std::string_view sql);
+bool isCallSql(std::string_view sql);
+bool isCommitSql(std::string_view sql);
+bool isWriteSql(std::string_view sql);
+std::string normalizeSql(std::string_view sql);
+std::vector<std::string> sqlTables(std::string_view sql);
+std::string substituteSqlPlaceholders(std::string_view sql, const std::vector<std::string> &literals);
+
+} // namespace bux
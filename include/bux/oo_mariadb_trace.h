@@ -0,0 +1,121 @@
+﻿#pragma once
+
+/*! \file
+    \brief Tracing spans of connect, prepare, bind, execute, result transfer and fetch, exported as Chrome trace JSON
+*/
+
+#include "oo_mariadb_observe.h" // bux::I_MyObserver
+#include <chrono>           // std::chrono::milliseconds
+#include <fstream>          // std::ofstream
+#include <stop_token>       // std::stop_token
+#include <thread>           // std::jthread
+
+namespace bux {
+
+//
+//      Types
+//
+struct C_MySpanContext
+/// \brief Identity of a span to be propagated as the parent of spans in other threads
+{
+    uint64_t    m_traceId{}, m_spanId{};
+};
+
+class C_MyTracer: public I_MyObserver
+/*! \brief Turn each C_MyOpEvent into a span, child of the innermost C_MyTraceScope of the same thread,
+    and export spans in batches to a file of Chrome trace format, viewable by <tt>chrome://tracing</tt> or Perfetto.
+
+    Spans are passed to the exporter thread through a bounded lock-free MPMC ring; those finding the ring full
+    are dropped and counted by dropped(). Register it by addObserver() and remove it by removeObserver()
+    before destruction.
+
+    <tt>mysql_query()</tt> and <tt>mysql_stmt_execute()</tt> block until the first reply packet, so MYOP_QUERY and
+    MYOP_EXEC spans include the server time plus the network wait, and MYOP_STORE and MYOP_FETCH spans the
+    transfer and decoding of results.
+*/
+{
+public:
+
+    // Types
+    struct C_Options
+    {
+        size_t                      m_ringSize{8192};       ///< Rounded up to a power of 2
+        std::chrono::milliseconds   m_flushInterval{200};
+    };
+    struct C_Span
+    {
+        C_MySpanContext m_context;
+        uint64_t        m_parentId;
+        const char      *m_name;        ///< Static string
+        int64_t         m_startNs, m_durationNs;
+        uint64_t        m_threadId;
+        unsigned long long m_rows;
+        unsigned        m_errno;
+        char            m_sql[120];     ///< Truncated
+    };
+
+    // Nonvirtuals
+    explicit C_MyTracer(std::string path);
+    C_MyTracer(std::string path, const C_Options &opts);
+    ~C_MyTracer();
+    C_MyTracer(const C_MyTracer&) = delete;
+    C_MyTracer &operator=(const C_MyTracer&) = delete;
+    auto dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    void record(const C_Span &span) noexcept;
+
+    // Implement I_MyObserver
+    void onOp(const C_MyOpEvent &ev) noexcept override;
+
+private:
+
+    // Types
+    struct C_Cell
+    {
+        std::atomic<size_t>     m_seq;
+        C_Span                  m_span;
+    };
+
+    // Data
+    const std::string               m_path;
+    const C_Options                 m_opts;
+    const size_t                    m_mask;
+    const std::unique_ptr<C_Cell[]> m_cells;
+    alignas(64) std::atomic<size_t> m_enqueuePos{};
+    alignas(64) std::atomic<size_t> m_dequeuePos{};
+    std::atomic<uint64_t>           m_dropped{};
+    std::ofstream                   m_out;          // Written by m_exporter once constructed
+    std::jthread                    m_exporter;
+
+    // Nonvirtuals
+    void exportSpans(std::stop_token stop);
+    bool pop(C_Span &span) noexcept;
+};
+
+class C_MyTraceScope
+/*! \brief Span of the caller's own work, e.g. a request handler, as the parent of spans of operations
+    issued by the same thread during the lifetime.
+*/
+{
+public:
+
+    // Nonvirtuals
+    C_MyTraceScope(C_MyTracer &tracer, const char *name) noexcept;
+    C_MyTraceScope(C_MyTracer &tracer, const char *name, const C_MySpanContext &parent) noexcept;
+    ~C_MyTraceScope();
+    C_MyTraceScope(const C_MyTraceScope&) = delete;
+    C_MyTraceScope &operator=(const C_MyTraceScope&) = delete;
+    auto &context() const { return m_context; }
+    static C_MySpanContext current() noexcept;
+
+private:
+
+    // Data
+    C_MyTracer                              &m_tracer;
+    const char                              *const m_name;
+    const C_MySpanContext                   m_outer;
+    C_MySpanContext                         m_context;
+    const uint64_t                          m_parentId;
+    const std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace bux
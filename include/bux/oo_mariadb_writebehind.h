@@ -0,0 +1,97 @@
+﻿#pragma once
+
+/*! \file
+    \brief Write-behind coalescing of counter increments into batched upserts
+*/
+
+#include "oo_mariadb.h"     // bux::C_MySQL
+#include <atomic>           // std::atomic<>
+#include <chrono>           // std::chrono::milliseconds
+#include <condition_variable>   // std::condition_variable
+#include <mutex>            // std::mutex
+#include <stop_token>       // std::stop_token
+#include <thread>           // std::jthread
+#include <unordered_map>    // std::unordered_map<>
+
+namespace bux {
+
+//
+//      Types
+//
+class C_MyWriteBehind
+/*! \brief Accumulate per-key deltas of a counter column in a sharded hash map and flush them periodically
+    as one <tt>INSERT ... ON DUPLICATE KEY UPDATE n=n+VALUES(n)</tt> per shard (chunked by C_Options::m_rowsPerStmt).
+
+    Keys being flushed count as pending until written. When C_Options::m_maxKeys keys are pending, add() of
+    a new key flushes its shard in the calling thread and, if that does not make room, drops the delta or
+    waits for room as C_Options::m_overflow says. Deltas of a failed flush are merged back and retried later;
+    those failing the final flush on destruction are lost. Database errors are never thrown by add() but
+    reported by lastError().
+
+    Flushes are at-least-once: if the connection drops after the server applied a statement but before its
+    reply arrives, the deltas are merged back and added again by the retry. Keep the counters approximate,
+    or make them exact by flushing into a table keyed by a batch id and summing it afterwards.
+*/
+{
+public:
+
+    // Types
+    enum E_Overflow
+    /// \brief What add() of a new key does when C_Options::m_maxKeys keys are still pending after a flush
+    {
+        OVERFLOW_BLOCK, ///< Wait till the background flush makes room
+        OVERFLOW_DROP   ///< Drop the delta, as counted by droppedDeltas()
+    };
+    struct C_Options
+    {
+        std::chrono::milliseconds   m_interval{1000};
+        size_t                      m_shards{16};
+        size_t                      m_maxKeys{100000};  ///< Bound of pending keys of all shards
+        size_t                      m_rowsPerStmt{1000};
+        E_Overflow                  m_overflow{OVERFLOW_BLOCK};
+    };
+
+    // Nonvirtuals
+    C_MyWriteBehind(const C_MySQL &connProto, std::string table, std::string keyColumn, std::string countColumn);
+    C_MyWriteBehind(const C_MySQL &connProto, std::string table, std::string keyColumn, std::string countColumn,
+        const C_Options &opts);
+    ~C_MyWriteBehind();
+    C_MyWriteBehind(const C_MyWriteBehind&) = delete;
+    C_MyWriteBehind &operator=(const C_MyWriteBehind&) = delete;
+    void add(std::string_view key, long long delta = 1);
+    auto droppedDeltas() const { return m_droppedDeltas.load(); }
+    void flush();
+    auto flushedRows() const { return m_flushedRows.load(); }
+    std::string lastError() const;
+    auto pendingKeys() const { return m_pendingKeys.load(); }
+
+private:
+
+    // Types
+    struct C_Shard
+    {
+        std::mutex                              m_lock;
+        std::unordered_map<std::string,long long> m_deltas;
+    };
+
+    // Data
+    C_MySQL                         m_mysql;
+    const std::string               m_table, m_keyColumn, m_countColumn;
+    const C_Options                 m_opts;
+    const std::unique_ptr<C_Shard[]> m_shards;
+    std::atomic<size_t>             m_pendingKeys{}, m_flushedRows{}, m_droppedDeltas{};
+    std::mutex                      m_connLock; // Guards m_mysql
+    std::mutex                      m_roomLock;
+    std::condition_variable         m_room;     // Notified whenever pending keys are written
+    mutable std::mutex              m_errorLock;
+    std::string                     m_lastError;
+    std::jthread                    m_flusher;
+
+    // Nonvirtuals
+    void flush(C_Shard &shard);
+    void flushNoThrow(C_Shard &shard) noexcept;
+    void setError(std::string_view error) noexcept;
+    bool tryAdd(C_Shard &shard, std::string_view key, long long delta);
+};
+
+} // namespace bux
@@ -1,8 +1,12 @@
 ﻿#include <bux/oo_mariadb.h>
+#include <bux/oo_mariadb_cache.h>   // bux::notifyWriteSql()
+#include <bux/oo_mariadb_observe.h> // bux::notifyOp(), bux::observing()
 #include <bux/XException.h> // LOGIC_ERROR(), RUNTIME_ERROR()
+#include <charconv>         // std::from_chars()
 #include <cstring>          // memset()
 #include <vector>           // std::vector<>
-#include <algorithm>        // std::min()
+#include <algorithm>        // std::min(), std::ranges::sort(), std::unique()
+#include <utility>          // std::exchange()
 #ifdef CLT_DEBUG_
 #include <bux/Logger.h>     // LOG(), FUNLOGX()
 #endif
@@ -15,6 +19,19 @@
  */
 namespace {
 
+//
+//      In-Module Constants
+//
+const char COUNTERS_KEY[] = "bux::C_MyConnCounters";    // Connector/C user data key
+
+//
+//      In-Module Data
+//
+std::atomic<unsigned long long>     g_roundTrips{};
+std::atomic<long long>              g_heldBytes{};
+thread_local bux::C_MyRoundTripScope *t_roundTripScope{};
+thread_local const bux::C_MyMemoryCap *t_memoryCap{};
+
 //
 //      In-Module Functions
 //
@@ -24,6 +41,221 @@ void flushResults(MYSQL *mysql) noexcept
         mysql_free_result(mysql_use_result(mysql));
 }
 
+void observe(bux::E_MyOp op, std::string_view sql, MYSQL *mysql, std::chrono::steady_clock::time_point start,
+    unsigned long long rows, unsigned long long bytes, unsigned retries, unsigned err) noexcept
+{
+    bux::C_MyOpEvent ev{op, sql, mysql, start};
+    ev.m_elapsed = std::chrono::steady_clock::now() - start;
+    ev.m_rows = rows;
+    ev.m_bytes = bytes;
+    ev.m_retries = retries;
+    ev.m_errno = err;
+    bux::notifyOp(ev);
+}
+
+bux::C_MyConnCounters *countersOf(MYSQL *mysql) noexcept
+/*! \return Counters of C_MySQL owning \a mysql, or nullptr if \a mysql is not owned by any
+*/
+{
+    void *ret{};
+    if (mysql)
+        mysql_get_optionv(mysql, MARIADB_OPT_USERDATA, const_cast<char*>(COUNTERS_KEY), &ret);
+
+    return static_cast<bux::C_MyConnCounters*>(ret);
+}
+
+std::shared_ptr<bux::C_MyConnCounters> sharedCountersOf(MYSQL *mysql) noexcept
+{
+    if (const auto counters = countersOf(mysql))
+        return counters->shared_from_this();
+
+    return {};
+}
+
+void accountMemory(bux::C_MyConnCounters *counters, long long delta) noexcept
+{
+    if (!delta)
+        return;
+
+    g_heldBytes.fetch_add(delta, std::memory_order_relaxed);
+    if (counters)
+        counters->m_heldBytes.fetch_add(delta, std::memory_order_relaxed);
+}
+
+size_t rowBytes(MYSQL_RES *res, unsigned n) noexcept
+/*! \return Estimated bytes held by the row just fetched from \a res of \a n columns
+*/
+{
+    size_t ret = (n + 1) * sizeof(char*);
+    const auto lengths = mysql_fetch_lengths(res);
+    for (unsigned i = 0; i < n; ++i)
+        ret += lengths[i] + 1;
+
+    return ret;
+}
+
+size_t storedBytes(MYSQL_RES *res, size_t maxBytes) noexcept
+/*! \return Estimated bytes held by a result stored by mysql_store_result(), or any value greater than
+    \a maxBytes as soon as known to exceed it, without measuring the rest
+*/
+{
+    const auto n = mysql_num_fields(res);
+    size_t ret = 0;
+    while (mysql_fetch_row(res))
+        if ((ret += rowBytes(res, n)) > maxBytes)
+            break;
+
+    mysql_data_seek(res, 0);
+    return ret;
+}
+
+size_t estimatedBytes(MYSQL_RES *res) noexcept
+/*! \return Rough upper bound of bytes held by a result stored by mysql_store_result(), as if every row were
+    as long as the max lengths of all columns, without a pass over the rows
+*/
+{
+    const auto n = mysql_num_fields(res);
+    const auto fields = mysql_fetch_fields(res);
+    size_t perRow = (n + 1) * sizeof(char*);
+    for (unsigned i = 0; i < n; ++i)
+        perRow += fields[i].max_length + 1;
+
+    return static_cast<size_t>(mysql_num_rows(res)) * perRow;
+}
+
+std::string capError(const std::string &what, size_t maxBytes)
+{
+    return std::format("{} exceeds the memory cap of {} bytes", what, maxBytes);
+}
+
+auto observeStart() noexcept
+{
+    return bux::observing()? std::chrono::steady_clock::now(): std::chrono::steady_clock::time_point{};
+}
+
+unsigned runQuery(MYSQL *mysql, const std::string &sql, bool retryLocks)
+/*! \return mysql_errno() of the failure, or 0 on success
+*/
+{
+    flushResults(mysql);
+    const auto start = observeStart();
+    unsigned retries = 0;
+Retry:
+    bux::countRoundTrip(mysql);
+    if (mysql_query(mysql, sql.c_str()))
+        switch (const auto err = mysql_errno(mysql))
+        {
+        case 1205: // From MySQL: "Lock wait timeout exceeded; try restarting transaction"
+        case 1213: // From MySQL: "Deadlock found when trying to get lock; try restarting transaction"
+            if (retryLocks)
+            {
+                ++retries;
+                goto Retry;
+            }
+            [[fallthrough]];
+        default:
+            if (bux::observing())
+                observe(bux::MYOP_QUERY, sql, mysql, start, 0, sql.size(), retries, err);
+
+            return err;
+        }
+
+    if (bux::observing())
+        observe(bux::MYOP_QUERY, sql, mysql, start, mysql_field_count(mysql)? 0: mysql_affected_rows(mysql), sql.size(), retries, 0);
+
+    bux::notifyWriteSql(sql);
+    return 0;
+}
+
+bux::T_MyExpected<bux::C_MySqlResult> queryResult(MYSQL *mysql, const std::string &sql, bux::E_MySqlResultKind kind, bool retryLocks)
+/*! \brief Implement both query() and tryQuery() returning C_MySqlResult
+*/
+{
+    const auto cap = bux::C_MyMemoryCap::current();
+    if (cap && cap->action() == bux::MYCAP_STREAM && kind == bux::MYSQL_STORE_RESULT)
+        // The size of a result is unknown until it is buffered as a whole
+        kind = bux::MYSQL_USE_RESULT;
+
+    if (const auto err = runQuery(mysql, sql, retryLocks))
+        return std::unexpected{bux::C_MyError{err, std::format("Query \"{}\"{}", sql, bux::errorSuffix(mysql))}};
+
+    const auto start = observeStart();
+    MYSQL_RES *res;
+    switch (kind)
+    {
+    case bux::MYSQL_USE_RESULT:
+        res = mysql_use_result(mysql);
+        break;
+    case bux::MYSQL_STORE_RESULT:
+        res = mysql_store_result(mysql);
+        break;
+    default:
+        return std::unexpected{bux::C_MyError{0, "Unknown result kind"}};
+    }
+    if (bux::observing())
+        observe(bux::MYOP_STORE, sql, mysql, start, res && kind == bux::MYSQL_STORE_RESULT? mysql_num_rows(res): 0, 0, 0, mysql_errno(mysql));
+
+    if (!res)
+    {
+        if (const auto err = mysql_errno(mysql))
+            return std::unexpected{bux::C_MyError{err, "Fail to store result"+bux::errorSuffix(mysql)}};
+
+        return std::unexpected{bux::C_MyError{0, "No result of '"+sql+'\''}};
+    }
+    if (kind != bux::MYSQL_STORE_RESULT)
+        return bux::C_MySqlResult{res};
+    if (!cap)
+        // Estimated only, as measuring costs another pass over the rows
+        return bux::C_MySqlResult{res, mysql, estimatedBytes(res)};
+
+    const auto bytes = storedBytes(res, cap->maxBytes());
+    if (bytes > cap->maxBytes())
+    {
+        mysql_free_result(res);
+        return std::unexpected{bux::C_MyError{0, capError("Stored result of \""+sql+'"', cap->maxBytes())}};
+    }
+    return bux::C_MySqlResult{res, mysql, bytes};
+}
+
+bux::T_MyExpected<bux::C_MyRowSet> queryRowSet(MYSQL *mysql, const std::string &sql, bool retryLocks)
+/*! \brief Implement both queryRows() and tryQueryRows()
+*/
+{
+    auto res = queryResult(mysql, sql, bux::MYSQL_USE_RESULT, retryLocks);
+    if (!res)
+        return std::unexpected{std::move(res.error())};
+
+    bux::C_MyRowSet ret;
+    const auto n = mysql_num_fields(*res);
+    const auto fields = mysql_fetch_fields(*res);
+    for (unsigned i = 0; i < n; ++i)
+        ret.m_fields.emplace_back(fields[i].name);
+
+    const auto cap = bux::C_MyMemoryCap::current();
+    size_t bytes = 0;
+    while (auto row = mysql_fetch_row(*res))
+    {
+        const auto lengths = mysql_fetch_lengths(*res);
+        auto &dst = ret.m_rows.emplace_back();
+        dst.reserve(n);
+        for (unsigned i = 0; i < n; ++i)
+            if (row[i])
+            {
+                dst.emplace_back(std::in_place, row[i], lengths[i]);
+                bytes += lengths[i];
+            }
+            else
+                dst.emplace_back();
+
+        if (cap && bytes > cap->maxBytes())
+            return std::unexpected{bux::C_MyError{0, capError("Rows of \""+sql+'"', cap->maxBytes())}};
+    }
+    if (const auto err = mysql_errno(mysql))
+        return std::unexpected{bux::C_MyError{err, std::format("Fetch rows of \"{}\"{}", sql, bux::errorSuffix(mysql))}};
+
+    return ret;
+}
+
 } // namespace
 
 namespace bux {
@@ -31,6 +263,72 @@ namespace bux {
 //
 //      Functions
 //
+C_MyLockStats &advisoryLockStats() noexcept
+{
+    static C_MyLockStats stats;
+    return stats;
+}
+
+void countRoundTrip(MYSQL *mysql) noexcept
+/*! \brief Count one request-response exchange with the server on \a mysql.
+    Call it only for raw Connector/C calls; wrappers of this library count their own.
+*/
+{
+    countRoundTrip(countersOf(mysql));
+}
+
+void countRoundTrip(C_MyConnCounters *counters) noexcept
+/*! \brief Count one request-response exchange with the server on the connection owning \a counters, if any
+*/
+{
+    g_roundTrips.fetch_add(1, std::memory_order_relaxed);
+    for (auto i = t_roundTripScope; i; i = i->m_outer)
+        ++i->m_count;
+
+    if (counters)
+        counters->m_roundTrips.fetch_add(1, std::memory_order_relaxed);
+}
+
+long long memoryHeld() noexcept
+/*! \return Bytes held by live stored results and bind arrays of all connections
+*/
+{
+    return g_heldBytes.load(std::memory_order_relaxed);
+}
+
+unsigned long long roundTrips() noexcept
+/*! \return Round trips of all connections so far
+*/
+{
+    return g_roundTrips.load(std::memory_order_relaxed);
+}
+
+C_MyLockStats &tableLockStats() noexcept
+{
+    static C_MyLockStats stats;
+    return stats;
+}
+
+E_MyErrorKind errorKind(unsigned errNo) noexcept
+{
+    switch (errNo)
+    {
+    case 1205: // ER_LOCK_WAIT_TIMEOUT
+    case 1213: // ER_LOCK_DEADLOCK
+        return MYERR_RETRYABLE;
+    case 2006: // CR_SERVER_GONE_ERROR
+    case 2013: // CR_SERVER_LOST
+    case 2055: // CR_SERVER_LOST_EXTENDED
+        return MYERR_CONNECTION;
+    case 1022: // ER_DUP_KEY
+    case 1062: // ER_DUP_ENTRY
+    case 1586: // ER_DUP_ENTRY_WITH_KEY_NAME
+        return MYERR_DUPLICATE;
+    default:
+        return MYERR_FATAL;
+    }
+}
+
 std::string errorSuffix(MYSQL *mysql)
 {
     std::string ret;
@@ -56,17 +354,20 @@ std::string errorSuffix(MYSQL_STMT *stmt)
 
 void query(MYSQL *mysql, const std::string &sql)
 {
-    flushResults(mysql);
-Retry:
-    if (mysql_query(mysql, sql.c_str()))
-        switch (mysql_errno(mysql))
-        {
-        case 1205: // From MySQL: "Lock wait timeout exceeded; try restarting transaction"
-        case 1213: // From MySQL: "Deadlock found when trying to get lock; try restarting transaction"
-            goto Retry;
-        default:
-            RUNTIME_ERROR("Query \"{}\"{}", sql, errorSuffix(mysql));
-        }
+    if (runQuery(mysql, sql, true))
+        RUNTIME_ERROR("Query \"{}\"{}", sql, errorSuffix(mysql));
+}
+
+T_MyExpected<void> tryQuery(MYSQL *mysql, const std::string &sql)
+/*! \brief Same as query() but return the error instead of throwing it.
+    Unlike query(), lock wait timeouts and deadlocks are not retried, because the server has rolled back the
+    statement or the whole transaction, which only the caller knows how to redo.
+*/
+{
+    if (const auto err = runQuery(mysql, sql, false))
+        return std::unexpected{C_MyError{err, std::format("Query \"{}\"{}", sql, errorSuffix(mysql))}};
+
+    return {};
 }
 
 void affect(MYSQL *mysql, const std::string &sql)
@@ -82,40 +383,108 @@ void affect(MYSQL *mysql, const std::string &sql)
     }
 }
 
+std::vector<unsigned long long> insertIds(MYSQL *mysql, const std::string &sql, size_t rows)
+/*! \brief Run multi-row <tt>INSERT</tt> \a sql and compute all the generated AUTO_INCREMENT ids from
+    <tt>LAST_INSERT_ID()</tt> and <tt>\@\@auto_increment_increment</tt>, in one round trip.
+    \param [in] mysql Connection
+    \param [in] sql <tt>INSERT</tt> of exactly \a rows rows, none of which specifies its id explicitly
+    \param [in] rows Expected number of inserted rows
+
+    Ids are consecutive only if <tt>innodb_autoinc_lock_mode</tt> is 0 or 1, or else <tt>std::runtime_error</tt>
+    is thrown after the rows have been inserted; use <tt>INSERT ... RETURNING</tt> with
+    C_MySqlStmt::execReturningIds() instead in that case.
+*/
+{
+    query(mysql, sql+";select @@auto_increment_increment,@@innodb_autoinc_lock_mode");
+    const auto first = mysql_insert_id(mysql);
+    const auto affected = mysql_affected_rows(mysql);
+    if (mysql_next_result(mysql))
+        RUNTIME_ERROR("Query auto-increment settings after \"{}\"{}", sql, errorSuffix(mysql));
+
+    const C_MySqlResult res = mysql_store_result(mysql);
+    const auto row = res? mysql_fetch_row(res): nullptr;
+    if (!row || !row[0] || !row[1])
+        RUNTIME_ERROR("No auto-increment settings{}", errorSuffix(mysql));
+
+    const auto step = strtoull(row[0], nullptr, 10);
+    if (const auto mode = strtoul(row[1], nullptr, 10); mode > 1)
+        RUNTIME_ERROR("Ids of \"{}\" are not guaranteed consecutive under innodb_autoinc_lock_mode={}", sql, mode);
+    if (affected != rows || !first)
+        RUNTIME_ERROR("{} rows affected with first id {} by \"{}\" instead of {} new rows", affected, first, sql, rows);
+
+    std::vector<unsigned long long> ret(rows);
+    for (size_t i = 0; i < rows; ++i)
+        ret[i] = first + i * step;
+
+    return ret;
+}
+
 C_MySqlResult query(MYSQL *mysql, const std::string &sql, E_MySqlResultKind kind)
 {
-    query(mysql, sql);
-    MYSQL_RES *res;
-    switch (kind)
+    auto ret = queryResult(mysql, sql, kind, true);
+    if (!ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+
+    return std::move(*ret);
+}
+
+T_MyExpected<C_MySqlResult> tryQuery(MYSQL *mysql, const std::string &sql, E_MySqlResultKind kind)
+/*! \brief Same as query() but return errors, including those of C_MyMemoryCap, instead of throwing them.
+    Lock wait timeouts and deadlocks are not retried, as by tryQuery(MYSQL*, const std::string&).
+*/
+{
+    return queryResult(mysql, sql, kind, false);
+}
+
+C_MyRowSet queryRows(MYSQL *mysql, const std::string &sql)
+{
+    auto ret = queryRowSet(mysql, sql, true);
+    if (!ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+
+    return std::move(*ret);
+}
+
+T_MyExpected<C_MyRowSet> tryQueryRows(MYSQL *mysql, const std::string &sql)
+/*! \brief Same as queryRows() but return errors instead of throwing them, without retrying lock errors
+*/
+{
+    return queryRowSet(mysql, sql, false);
+}
+
+void queryEachRow(MYSQL *mysql, const std::string &sql, std::function<bool(MYSQL_ROW row, const unsigned long *lengths)> nextRow)
+/*! \brief Stream rows of \a sql by mysql_use_result() until \a nextRow returns false
+
+    Under C_MyMemoryCap, any single row, the most buffered at a time, is capped.
+*/
+{
+    const auto res = query(mysql, sql, MYSQL_USE_RESULT);
+    const auto cap = C_MyMemoryCap::current();
+    const auto n = mysql_num_fields(res);
+    while (auto row = mysql_fetch_row(res))
     {
-    case MYSQL_USE_RESULT:
-        res = mysql_use_result(mysql);
-        break;
-    case MYSQL_STORE_RESULT:
-        res = mysql_store_result(mysql);
-        break;
-    default:
-        RUNTIME_ERROR("Unknown result kind");
+        if (cap)
+            cap->check(rowBytes(res, n), "Row of \""+sql+'"');
+        if (!nextRow(row, mysql_fetch_lengths(res)))
+            return;
     }
-    if (!res)
-    {
-        std::string err;
-        if (mysql_errno(mysql))
-            err = "Fail to store result"+errorSuffix(mysql);
-        else
-            err = "No result of '"+sql+'\'';
 
-        RUNTIME_ERROR("{}", err);
-    }
-    return res;
+    if (mysql_errno(mysql))
+        RUNTIME_ERROR("Fetch rows of \"{}\"{}", sql, errorSuffix(mysql));
 }
 
 void queryColumn(MYSQL *mysql, const std::string &sql, std::function<bool(const char*)> nextRow, int colInd)
 {
     const auto res = query(mysql, sql, MYSQL_USE_RESULT);
+    const auto cap = C_MyMemoryCap::current();
+    const auto n = mysql_num_fields(res);
     while (auto row = mysql_fetch_row(res))
+    {
+        if (cap)
+            cap->check(rowBytes(res, n), "Row of \""+sql+'"');
         if (!nextRow(row[colInd]))
             break;
+    }
 }
 
 std::string queryString(MYSQL *mysql, const std::string &sql, int colInd)
@@ -132,6 +501,29 @@ std::string queryString(MYSQL *mysql, const std::string &sql, int colInd)
     return ret;
 }
 
+T_MyExpected<std::string> tryQueryString(MYSQL *mysql, const std::string &sql, int colInd)
+/*! \brief Same as queryString() but return errors instead of throwing them, without retrying lock errors
+*/
+{
+    auto res = queryResult(mysql, sql, MYSQL_USE_RESULT, false);
+    if (!res)
+        return std::unexpected{std::move(res.error())};
+
+    const auto cap = C_MyMemoryCap::current();
+    const auto n = mysql_num_fields(*res);
+    while (auto row = mysql_fetch_row(*res))
+    {
+        if (cap && rowBytes(*res, n) > cap->maxBytes())
+            return std::unexpected{C_MyError{0, capError("Row of \""+sql+'"', cap->maxBytes())}};
+        if (row[colInd])
+            return std::string{row[colInd], mysql_fetch_lengths(*res)[colInd]};
+    }
+    if (const auto err = mysql_errno(mysql))
+        return std::unexpected{C_MyError{err, std::format("Fetch rows of \"{}\"{}", sql, errorSuffix(mysql))}};
+
+    return std::string{};
+}
+
 unsigned long queryULong(MYSQL *mysql, const std::string &sql, int colInd)
 {
     unsigned long ret = 0;
@@ -150,6 +542,17 @@ unsigned long queryULong(MYSQL *mysql, const std::string &sql, int colInd)
     return ret;
 }
 
+std::string quotedSql(MYSQL *mysql, std::string_view str)
+/*! \return \a str escaped by mysql_real_escape_string() and enclosed by single quotes
+*/
+{
+    std::string ret(str.size() * 2 + 2, '\'');
+    const auto n = mysql_real_escape_string(mysql, ret.data() + 1, str.data(), static_cast<unsigned long>(str.size()));
+    ret.resize(n + 2);
+    ret.back() = '\'';
+    return ret;
+}
+
 std::string getTableSchema(MYSQL *mysql, const std::string &db_name, const std::string &table_name)
 {
     const std::string db_prefix = '`' + db_name + "`.";
@@ -211,6 +614,7 @@ void useDatabase(MYSQL *mysql, const std::string &db_name)
 #ifdef CLT_DEBUG_
     FUNLOGX(db_name);
 #endif
+    countRoundTrip(mysql);
     if (mysql_select_db(mysql, db_name.c_str()))
         RUNTIME_ERROR("Use database {}{}", db_name, errorSuffix(mysql));
 }
@@ -277,36 +681,87 @@ enum_field_types typeOfIntSize(size_t n)
 //
 //      Implemen Classes
 //
+C_MyError::C_MyError(unsigned errNo, std::string what):
+    m_errno(errNo),
+    m_kind(errorKind(errNo)),
+    m_what(std::move(what))
+{
+}
+
+C_MySQL::C_MySQL(C_MySQL &&t) noexcept: m_getConnArg(t.m_getConnArg)  // Shared, not copied
+{
+    takeOver(t);
+}
+
 C_MySQL::~C_MySQL()
 {
     disconnect();
 }
 
-MYSQL *C_MySQL::mysql()
+C_MySQL &C_MySQL::operator=(C_MySQL &&t) noexcept
+{
+    if (this != &t)
+    {
+        disconnect();
+        m_getConnArg = t.m_getConnArg;
+        takeOver(t);
+    }
+    return *this;
+}
+
+bool C_MySQL::alive()
+/*! \return true if still connected, as checked by mysql_ping()
+*/
 {
     if (m_pstmt)
         m_pstmt->clear();
 
-    if (m_mysql &&
-        (flushResults(m_mysql), !mysql_ping(m_mysql)))
+    if (!m_mysql ||
+        (flushResults(m_mysql), countRoundTrip(m_counters.get()), mysql_ping(m_mysql)))
+        return false;
+
+    const auto cur_id = mysql_thread_id(m_mysql);
+    if (cur_id != m_threadID)
     {
-        const auto cur_id = mysql_thread_id(m_mysql);
-        if (cur_id != m_threadID)
-        {
 #ifdef CLT_DEBUG_
-            LOG(LL_INFO, "mysql_ping() obtained new thread id {} obsoleting the old {}", cur_id, m_threadID);
+        LOG(LL_INFO, "mysql_ping() obtained new thread id {} obsoleting the old {}", cur_id, m_threadID);
 #endif
-            m_threadID = cur_id;
-            m_pstmt.reset();
-        }
+        m_threadID = cur_id;
+        m_pstmt.reset();
     }
-    else
+    return true;
+}
+
+MYSQL *C_MySQL::mysql()
+{
+    if (!alive())
         connect_();
 
     return m_mysql;
 }
 
+T_MyExpected<MYSQL*> C_MySQL::tryMysql()
+/*! \brief Same as mysql() but return errors of reconnection instead of throwing them
+*/
+{
+    if (!alive())
+        if (auto ret = tryConnect_(); !ret)
+            return std::unexpected{std::move(ret.error())};
+
+    return m_mysql;
+}
+
 void C_MySQL::connect_()
+/*! \brief Connect for mysql() and throw what tryConnect_() returns on failure
+*/
+{
+    if (const auto ret = tryConnect_(); !ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+}
+
+T_MyExpected<void> C_MySQL::tryConnect_()
+/*! \brief Connect for tryMysql() and connect_()
+*/
 {
 #ifdef CLT_DEBUG_
     if (!m_mysql)
@@ -316,11 +771,12 @@ void C_MySQL::connect_()
 #endif
     disconnect();
 
+    const auto start = observeStart();
     MYSQL *const mysql = mysql_init(nullptr);
     if (!mysql)
-        LOGIC_ERROR("mysql_init() failed");
+        return std::unexpected{C_MyError{0, "mysql_init() failed"}};
 
-    const auto arg = m_getConnArg();
+    const auto arg = (*m_getConnArg)();
     const char *whatPrefix;
     if (mysql_options(mysql, MYSQL_SET_CHARSET_NAME, arg.m_charset.c_str()))
         whatPrefix = "Fail to set charset";
@@ -339,20 +795,33 @@ void C_MySQL::connect_()
             // Connected successfully
         {
             m_mysql = mysql;
-            query(mysql, "SET sql_mode = 'STRICT_ALL_TABLES'");
+            if (!m_counters)
+                m_counters = std::make_shared<C_MyConnCounters>();
+
+            mysql_optionsv(mysql, MARIADB_OPT_USERDATA, const_cast<char*>(COUNTERS_KEY), m_counters.get());
+            countRoundTrip(m_counters.get());
+            if (observing())
+                observe(MYOP_CONNECT, {}, mysql, start, 0, 0, 0, 0);
+
+            if (auto ret = tryQuery(mysql, "SET sql_mode = 'STRICT_ALL_TABLES'"); !ret)
+                return ret;
+
             m_threadID = mysql_thread_id(mysql);
 #ifdef CLT_DEBUG_
             LOG(LL_INFO, "Connected to MySQL on {} as user '{}' and thread id {}", arg.m_host, arg.m_user, m_threadID);
 #endif
-            return;
+            return {};
         }
         whatPrefix = "Fail to connect";
     }
 
     // Something went wrong
-    const std::string err = errorSuffix(mysql);
+    if (observing())
+        observe(MYOP_CONNECT, {}, mysql, start, 0, 0, 0, mysql_errno(mysql));
+
+    C_MyError err{mysql_errno(mysql), whatPrefix + errorSuffix(mysql)};
     mysql_close(mysql);
-    RUNTIME_ERROR("{}{}", whatPrefix, err);
+    return std::unexpected{std::move(err)};
 }
 
 void C_MySQL::disconnect()
@@ -369,11 +838,25 @@ C_MySqlStmt &C_MySQL::stmt()
 {
     MYSQL *const my = mysql();  // trigger mysql_ping()
     if (!m_pstmt)
-        m_pstmt.reset(new C_MySqlStmt(my));
+        m_pstmt.emplace(my);
 
     return *m_pstmt;
 }
 
+void C_MySQL::takeOver(C_MySQL &t) noexcept
+/*! \brief Take over the connection, counters and statement of \a t, which is left disconnected
+    but keeps its connection argument to reconnect on demand.
+*/
+{
+    m_mysql = std::exchange(t.m_mysql, nullptr);
+    m_threadID = std::exchange(t.m_threadID, 0);
+    m_pstmt = std::move(t.m_pstmt);
+    t.m_pstmt.reset();
+
+    // The connection user data still points to the same counters on heap
+    m_counters = std::move(t.m_counters);
+}
+
 unsigned long C_MySQL::threadId()
 {
     if (!m_mysql)
@@ -382,29 +865,74 @@ unsigned long C_MySQL::threadId()
     return m_threadID;
 }
 
+/*! \param [in] res Result owned from now on
+    \param [in] mysql Connection to which \a bytes are accounted till destruction, even after disconnected
+    \param [in] bytes Estimated memory held by \a res
+*/
+C_MySqlResult::C_MySqlResult(MYSQL_RES *res, MYSQL *mysql, size_t bytes):
+    m_res(res),
+    m_counters(bytes? sharedCountersOf(mysql): nullptr),
+    m_bytes(bytes)
+{
+    accountMemory(m_counters.get(), static_cast<long long>(bytes));
+}
+
 void C_MySqlResult::operator=(C_MySqlResult &&t) noexcept
 {
     destroy();
     m_res = t.m_res;
+    m_counters = std::move(t.m_counters);
+    m_bytes = t.m_bytes;
     t.m_res = {};
 }
 
 void C_MySqlResult::destroy()
 {
     if (m_res)
+    {
         mysql_free_result(m_res);
+        accountMemory(m_counters.get(), -static_cast<long long>(m_bytes));
+    }
 }
 
-C_MySqlStmt::C_MySqlStmt(MYSQL *mysql): m_stmt(mysql_stmt_init(mysql))
+C_MySqlStmt::C_MySqlStmt(MYSQL *mysql): m_stmt(mysql_stmt_init(mysql)), m_counters(sharedCountersOf(mysql))
 {
     if (!m_stmt)
         RUNTIME_ERROR("Fail to init stmt{}", errorSuffix(mysql));
 }
 
+C_MySqlStmt::C_MySqlStmt(C_MySqlStmt &&t) noexcept:
+    m_stmt(std::exchange(t.m_stmt, nullptr)),
+    m_sql(std::move(t.m_sql)),
+    m_bindSize(std::exchange(t.m_bindSize, 0)),
+    m_bindSizeLimit(std::exchange(t.m_bindSizeLimit, 0)),
+    m_bindArr(std::move(t.m_bindArr)),
+    m_boundParams(std::exchange(t.m_boundParams, 0)),
+    m_maxPacketBytes(t.m_maxPacketBytes),
+    m_counters(std::move(t.m_counters))
+{
+}
+
 C_MySqlStmt::~C_MySqlStmt()
 {
-    if (m_stmt)
-        mysql_stmt_close(m_stmt);
+    destroy();
+}
+
+C_MySqlStmt &C_MySqlStmt::operator=(C_MySqlStmt &&t) noexcept
+{
+    if (this != &t)
+    {
+        destroy();
+        m_stmt = std::exchange(t.m_stmt, nullptr);
+        m_sql = std::move(t.m_sql);
+        m_bindSize = std::exchange(t.m_bindSize, 0);
+        m_bindSizeLimit = std::exchange(t.m_bindSizeLimit, 0);
+        m_bindArr = std::move(t.m_bindArr);
+        m_boundParams = std::exchange(t.m_boundParams, 0);
+        m_maxPacketBytes = t.m_maxPacketBytes;
+        m_counters = std::move(t.m_counters);
+    }
+    return *this;
 }
 
 bool C_MySqlStmt::affected() const
@@ -414,6 +942,7 @@ bool C_MySqlStmt::affected() const
 
 void C_MySqlStmt::allocBind(size_t count)
 {
+    const auto oldLimit = m_bindSizeLimit;
     if (m_bindSizeLimit < count)
     {
         m_bindSizeLimit = count;
@@ -428,32 +957,64 @@ void C_MySqlStmt::allocBind(size_t count)
         m_bindArr.reset();
         m_bindSizeLimit = 0;
     }
+    accountMemory(m_counters.get(), (static_cast<long long>(m_bindSizeLimit) - static_cast<long long>(oldLimit)) *
+        static_cast<long long>(sizeof(MYSQL_BIND)));
 }
 
 void C_MySqlStmt::bindParams(const std::function<void(MYSQL_BIND *barr)> &binder)
 {
+    if (const auto ret = tryBindParams(binder); !ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+}
+
+T_MyExpected<void> C_MySqlStmt::tryBindParams(const std::function<void(MYSQL_BIND *barr)> &binder)
+/*! \brief Same as bindParams() but return errors of Connector/C instead of throwing them.
+    Exceptions thrown by \a binder itself propagate as they are.
+*/
+{
+    const auto start = observeStart();
     allocBind(mysql_stmt_param_count(m_stmt));
     const auto barr = bindArray();
     binder(barr);
     std::vector<size_t> longParams;
-    for (size_t i = 0; i < m_bindSize; ++i)
-        if (barr[i].buffer_length > maxAllowedPacket())
-            longParams.emplace_back(i);
+    unsigned step = 0;
+    if (m_bindSize)
+    {
+        const auto maxPacket = tryMaxAllowedPacket();
+        if (!maxPacket)
+            return std::unexpected{maxPacket.error()};
+
+        step = *maxPacket;
+        for (size_t i = 0; i < m_bindSize; ++i)
+            if (barr[i].buffer_length > step)
+                longParams.emplace_back(i);
+    }
 
+    m_boundParams = 0;
     if (mysql_stmt_bind_param(m_stmt, barr))
-        RUNTIME_ERROR("Fail to bind params{}", errorSuffix(m_stmt));
+        return std::unexpected{C_MyError{mysql_stmt_errno(m_stmt), "Fail to bind params" + errorSuffix(m_stmt)}};
+
+    m_boundParams = static_cast<unsigned long>(m_bindSize);
 
     for (auto i: longParams)
     {
         const MYSQL_BIND &src = barr[i];
-        const auto step = maxAllowedPacket();
         for (unsigned off = 0; off < src.buffer_length; off += step)
         {
             const auto bytes = std::min(step, unsigned(src.buffer_length-off));
             if (mysql_stmt_send_long_data(m_stmt, unsigned(i), static_cast<const char*>(src.buffer)+off, bytes))
-                RUNTIME_ERROR("Fail to send long data part of {} bytes", bytes);
+                return std::unexpected{C_MyError{mysql_stmt_errno(m_stmt), std::format("Fail to send long data part of {} bytes", bytes)}};
         }
     }
+    if (observing())
+    {
+        unsigned long long bytes = 0;
+        for (size_t i = 0; i < m_bindSize; ++i)
+            bytes += barr[i].length? *barr[i].length: barr[i].buffer_length;
+
+        observe(MYOP_BIND, m_sql, m_stmt->mysql, start, 0, bytes, 0, 0);
+    }
+    return {};
 }
 
 void C_MySqlStmt::clear() const
@@ -461,6 +1022,15 @@ void C_MySqlStmt::clear() const
     mysql_stmt_free_result(m_stmt);
 }
 
+void C_MySqlStmt::destroy() noexcept
+{
+    if (m_stmt)
+    {
+        accountMemory(m_counters.get(), -static_cast<long long>(m_bindSizeLimit * sizeof(MYSQL_BIND)));
+        mysql_stmt_close(m_stmt);
+    }
+}
+
 void C_MySqlStmt::exec() const
 {
     if (execNoThrow())
@@ -469,95 +1039,370 @@ void C_MySqlStmt::exec() const
 
 unsigned C_MySqlStmt::execNoThrow() const
 {
-Retry:
-    if (mysql_stmt_execute(m_stmt))
-    {
-        switch (auto ret = mysql_stmt_errno(m_stmt))
-        {
-        case 1213:
-            // From MySQL: "Deadlock found when trying to get lock; try restarting transaction"
-            goto Retry;
-        default:
-            return ret;
-        }
-    }
-    return 0;
+    return execute(true);
 }
 
-MYSQL_BIND *C_MySqlStmt::execBindResults(const std::function<void(MYSQL_BIND *barr)> &binder)
+T_MyExpected<void> C_MySqlStmt::tryExec() const
+/*! \brief Same as exec() but return the error instead of throwing it.
+    Unlike exec(), deadlocks are not retried, because the server has rolled back the whole transaction,
+    which only the caller knows how to redo.
+*/
 {
-    exec();
-    allocBind(mysql_stmt_field_count(m_stmt));
-    const auto barr = bindArray();
-    binder(barr);
-    if (mysql_stmt_bind_result(m_stmt, barr))
-        RUNTIME_ERROR("Fail to bind result{}", errorSuffix(m_stmt));
+    if (const auto err = execute(false))
+        return std::unexpected{C_MyError{err, "Fail to execute" + errorSuffix(m_stmt)}};
 
-    return barr;
+    return {};
 }
 
-std::pair<const void*,size_t> C_MySqlStmt::getLongBlob(size_t i, std::function<void*(size_t bytes)> alloc) const
+T_MyExpected<MYSQL_BIND*> C_MySqlStmt::tryExecBindResults(const std::function<void(MYSQL_BIND *barr)> &binder)
+/*! \brief Same as execBindResults() but return errors of Connector/C instead of throwing them, without
+    retrying deadlocks. Exceptions thrown by \a binder itself propagate as they are.
+*/
+{
+    return executeBindResults(binder, false);
+}
+
+T_MyExpected<C_MyRowSet> C_MySqlStmt::tryExecFetchRows()
+/*! \brief Same as execFetchRows() but return errors, including those of C_MyMemoryCap, instead of throwing
+    them, without retrying deadlocks
+*/
+{
+    return executeFetchRows(false);
+}
+
+T_MyExpected<std::vector<unsigned long long>> C_MySqlStmt::tryExecReturningIds()
+/*! \brief Same as execReturningIds() but return errors instead of throwing them, without retrying deadlocks.
+    A statement without RETURNING clause is still a logic error thrown.
+*/
+{
+    return executeReturningIds(false);
+}
+
+T_MyExpected<std::pair<const void*,size_t>> C_MySqlStmt::tryGetLongBlob(size_t i, std::function<void*(size_t bytes)> alloc) const
+/*! \brief Same as getLongBlob() but return errors, including those of C_MyMemoryCap, instead of throwing them.
+    Exceptions thrown by \a alloc itself propagate as they are.
+*/
 {
     MYSQL_BIND bindBlob;
     memset(&bindBlob, 0, sizeof bindBlob);
     auto &bind = bindArray()[i];
     if (bind.is_null_value)
-        return {{}, 0};
+        return std::pair<const void*,size_t>{};
+
+    if (const auto cap = C_MyMemoryCap::current(); cap && bind.length_value > cap->maxBytes())
+        // Fail before allocating
+        return std::unexpected{C_MyError{0, capError(std::format("Blob of column {}", i), cap->maxBytes())}};
 
+    // Held by the fetch here, and by the caller afterwards
+    const auto bytes = static_cast<long long>(bind.length_value);
+    accountMemory(m_counters.get(), bytes);
+    struct C_Release
+    {
+        C_MyConnCounters *const m_counters;
+        const long long         m_bytes;
+        ~C_Release() { accountMemory(m_counters, -m_bytes); }
+    } release{m_counters.get(), bytes};
     bindBlob.buffer = alloc(bind.length_value);
     m_stmt->bind[i].length_value =
     bindBlob.buffer_length = bind.length_value;
     bindBlob.length = &bindBlob.length_value;
     bindBlob.buffer_type = bind.buffer_type;
     if (mysql_stmt_fetch_column(m_stmt, &bindBlob, static_cast<unsigned>(i), 0))
-        RUNTIME_ERROR("Fail to fetch blob data{}", errorSuffix(m_stmt));
+        return std::unexpected{C_MyError{mysql_stmt_errno(m_stmt), "Fail to fetch blob data" + errorSuffix(m_stmt)}};
 
-    return {bindBlob.buffer, bind.length_value};
+    return std::pair<const void*,size_t>{bindBlob.buffer, bind.length_value};
 }
 
-std::string C_MySqlStmt::getLongBlob(size_t i) const
+T_MyExpected<std::string> C_MySqlStmt::tryGetLongBlob(size_t i) const
 {
     std::unique_ptr<char[]> buf;
-    const size_t n = getLongBlob(i,
+    const auto ret = tryGetLongBlob(i,
         [&buf](size_t bytes) {
             buf = std::make_unique<char[]>(bytes);
             return buf.get();
         }
-    ).second;
-    return {buf.get(), n};
+    );
+    if (!ret)
+        return std::unexpected{ret.error()};
+
+    return std::string{buf.get(), ret->second};
+}
+
+unsigned C_MySqlStmt::execute(bool retryDeadlock) const
+/*! \return mysql_stmt_errno() of the failure, or 0 on success
+*/
+{
+    const auto start = observeStart();
+    unsigned retries = 0;
+    unsigned ret;
+Retry:
+    countRoundTrip(m_counters.get());
+    if (mysql_stmt_execute(m_stmt))
+    {
+        switch (ret = mysql_stmt_errno(m_stmt))
+        {
+        case 1213:
+            // From MySQL: "Deadlock found when trying to get lock; try restarting transaction"
+            if (retryDeadlock)
+            {
+                ++retries;
+                goto Retry;
+            }
+            break;
+        default:;
+        }
+    }
+    else
+        ret = 0;
+
+    if (observing())
+    {
+        C_MyOpEvent ev{MYOP_EXEC, m_sql, m_stmt->mysql, start};
+        ev.m_elapsed = std::chrono::steady_clock::now() - start;
+        if (!ret && !mysql_stmt_field_count(m_stmt))
+            ev.m_rows = mysql_stmt_affected_rows(m_stmt);
+
+        ev.m_retries = retries;
+        ev.m_errno = ret;
+        if (m_boundParams)
+        {
+            // Copied by mysql_stmt_bind_param(), unlike m_bindArr which is reused for results
+            ev.m_params = m_stmt->params;
+            ev.m_paramCount = m_boundParams;
+        }
+        notifyOp(ev);
+    }
+    if (!ret)
+        notifyWriteSql(m_sql);
+
+    return ret;
+}
+
+MYSQL_BIND *C_MySqlStmt::execBindResults(const std::function<void(MYSQL_BIND *barr)> &binder)
+{
+    const auto ret = executeBindResults(binder, true);
+    if (!ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+
+    return *ret;
 }
 
-unsigned C_MySqlStmt::maxAllowedPacket() const
+T_MyExpected<MYSQL_BIND*> C_MySqlStmt::executeBindResults(const std::function<void(MYSQL_BIND *barr)> &binder, bool retryDeadlock)
+/*! \brief Implement both execBindResults() and tryExecBindResults()
+*/
+{
+    if (const auto err = execute(retryDeadlock))
+        return std::unexpected{C_MyError{err, "Fail to execute" + errorSuffix(m_stmt)}};
+
+    allocBind(mysql_stmt_field_count(m_stmt));
+    const auto barr = bindArray();
+    binder(barr);
+    if (mysql_stmt_bind_result(m_stmt, barr))
+        return std::unexpected{C_MyError{mysql_stmt_errno(m_stmt), "Fail to bind result" + errorSuffix(m_stmt)}};
+
+    return barr;
+}
+
+T_MyExpected<C_MyRowSet> C_MySqlStmt::executeFetchRows(bool retryDeadlock)
+/*! \brief Implement both execFetchRows() and tryExecFetchRows()
+*/
+{
+    C_MyRowSet ret;
+    if (const C_MySqlResult meta = mysql_stmt_result_metadata(m_stmt))
+    {
+        const auto n = mysql_num_fields(meta);
+        const auto fields = mysql_fetch_fields(meta);
+        for (unsigned i = 0; i < n; ++i)
+            ret.m_fields.emplace_back(fields[i].name);
+    }
+    const auto n = ret.m_fields.size();
+    if (!n)
+    {
+        if (const auto err = execute(retryDeadlock))
+            return std::unexpected{C_MyError{err, "Fail to execute" + errorSuffix(m_stmt)}};
+
+        return ret;
+    }
+    const auto bound = executeBindResults([n](MYSQL_BIND *barr){
+        for (size_t i = 0; i < n; ++i)
+            bindStrBuffer(barr[i], nullptr, 0); // Every column is fetched as truncated and then by getLongBlob()
+    }, retryDeadlock);
+    if (!bound)
+        return std::unexpected{bound.error()};
+
+    const auto cap = C_MyMemoryCap::current();
+    size_t bytes = 0;
+    for (;;)
+    {
+        const auto more = tryNextRow();
+        if (!more)
+            return std::unexpected{more.error()};
+        if (!*more)
+            break;
+
+        auto &dst = ret.m_rows.emplace_back();
+        dst.reserve(n);
+        for (size_t i = 0; i < n; ++i)
+            if (bindArray()[i].is_null_value)
+                dst.emplace_back();
+            else if (auto blob = tryGetLongBlob(i))
+                bytes += dst.emplace_back(std::move(*blob))->size();
+            else
+                return std::unexpected{blob.error()};
+
+        if (cap && bytes > cap->maxBytes())
+            return std::unexpected{C_MyError{0, capError("Rows of \""+m_sql+'"', cap->maxBytes())}};
+    }
+    return ret;
+}
+
+T_MyExpected<std::vector<unsigned long long>> C_MySqlStmt::executeReturningIds(bool retryDeadlock)
+/*! \brief Implement both execReturningIds() and tryExecReturningIds()
+*/
+{
+    if (!mysql_stmt_field_count(m_stmt))
+        LOGIC_ERROR("No RETURNING clause in \"{}\"", m_sql);
+
+    unsigned long long id;
+    const auto bound = executeBindResults([&](MYSQL_BIND *barr) {
+        bindInt(barr[0], id);
+        for (size_t i = 1; i < m_bindSize; ++i)
+            barr[i].buffer_type = MYSQL_TYPE_NULL; // Skipped
+    }, retryDeadlock);
+    if (!bound)
+        return std::unexpected{bound.error()};
+
+    std::vector<unsigned long long> ret;
+    for (;;)
+    {
+        const auto more = tryNextRow();
+        if (!more)
+            return std::unexpected{more.error()};
+        if (!*more)
+            break;
+
+        if (!bindArray()->is_null_value)
+            ret.emplace_back(id);
+    }
+    return ret;
+}
+
+C_MyRowSet C_MySqlStmt::execFetchRows()
+{
+    auto ret = executeFetchRows(true);
+    if (!ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+
+    return std::move(*ret);
+}
+
+std::vector<unsigned long long> C_MySqlStmt::execReturningIds()
+/*! \brief Execute <tt>INSERT ... RETURNING id</tt> (MariaDB 10.5+) and collect the first column of all rows
+*/
+{
+    auto ret = executeReturningIds(true);
+    if (!ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+
+    return std::move(*ret);
+}
+
+std::pair<const void*,size_t> C_MySqlStmt::getLongBlob(size_t i, std::function<void*(size_t bytes)> alloc) const
+{
+    const auto ret = tryGetLongBlob(i, std::move(alloc));
+    if (!ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+
+    return *ret;
+}
+
+std::string C_MySqlStmt::getLongBlob(size_t i) const
+{
+    auto ret = tryGetLongBlob(i);
+    if (!ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+
+    return std::move(*ret);
+}
+
+T_MyExpected<unsigned> C_MySqlStmt::tryMaxAllowedPacket() const
+/*! \return Half of <tt>@@max_allowed_packet</tt>, queried once per statement, as the chunk size of long data
+*/
 {
     if (!m_maxPacketBytes)
     {
-        C_MySqlStmt stmt(m_stmt->mysql);    // Access of m_stmt->mysql is undocumented
-        stmt.prepare("select @@max_allowed_packet");
-        stmt.execBindResults([this](auto barr){
-            bindInt(*barr, m_maxPacketBytes);
-        });
-        if (!stmt.nextRow() || m_maxPacketBytes % 1024)
+        // Access of m_stmt->mysql is undocumented
+        const auto value = tryQueryString(m_stmt->mysql, "select @@max_allowed_packet");
+        if (!value)
+            return std::unexpected{value.error()};
+
+        unsigned bytes = 0;
+        if (std::from_chars(value->data(), value->data() + value->size(), bytes).ec != std::errc{} || !bytes || bytes % 1024)
             // Null or odd answer
-            m_maxPacketBytes = 65536;
+            bytes = 65536;
 
-        m_maxPacketBytes /= 2;
+        m_maxPacketBytes = bytes / 2;
     }
     return m_maxPacketBytes;
 }
 
 bool C_MySqlStmt::nextRow() const
 {
+    const auto ret = tryNextRow();
+    if (!ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+
+    return *ret;
+}
+
+T_MyExpected<bool> C_MySqlStmt::tryNextRow() const
+/*! \brief Same as nextRow() but return the error instead of throwing it
+*/
+{
+    const auto start = observeStart();
     const int err = mysql_stmt_fetch(m_stmt);
+    if (observing())
+    {
+        unsigned long long bytes = 0;
+        if (err != 1 && err != MYSQL_NO_DATA)
+            for (size_t i = 0; i < m_bindSize; ++i)
+            {
+                const auto &b = bindArray()[i];
+                bytes += b.length? *b.length: b.buffer_length;
+            }
+
+        observe(MYOP_FETCH, m_sql, m_stmt->mysql, start, err != 1 && err != MYSQL_NO_DATA, bytes, 0,
+            err == 1? mysql_stmt_errno(m_stmt): 0);
+    }
     if (err == 1)
-        RUNTIME_ERROR("Fail to fetch row{}", errorSuffix(m_stmt));
+        return std::unexpected{C_MyError{mysql_stmt_errno(m_stmt), "Fail to fetch row" + errorSuffix(m_stmt)}};
 
     return err != MYSQL_NO_DATA;
 }
 
 void C_MySqlStmt::prepare(const std::string &sql) const
 {
-    if (mysql_stmt_prepare(m_stmt, sql.c_str(), static_cast<unsigned long>(sql.size())))
-        RUNTIME_ERROR("Prepare \"{}\"{}", sql, errorSuffix(m_stmt));
+    if (const auto ret = tryPrepare(sql); !ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+}
+
+T_MyExpected<void> C_MySqlStmt::tryPrepare(const std::string &sql) const
+/*! \brief Same as prepare() but return the error instead of throwing it
+*/
+{
+    m_sql.clear();
+    m_boundParams = 0;
+    const auto start = observeStart();
+    countRoundTrip(m_counters.get());
+    const auto failed = mysql_stmt_prepare(m_stmt, sql.c_str(), static_cast<unsigned long>(sql.size()));
+    if (observing())
+        observe(MYOP_PREPARE, sql, m_stmt->mysql, start, 0, sql.size(), 0, failed? mysql_stmt_errno(m_stmt): 0);
+
+    if (failed)
+        return std::unexpected{C_MyError{mysql_stmt_errno(m_stmt), std::format("Prepare \"{}\"{}", sql, errorSuffix(m_stmt))}};
+
+    m_sql = sql;
+    return {};
 }
 
 bool C_MySqlStmt::queryUint(unsigned &dst)
@@ -571,6 +1416,45 @@ bool C_MySqlStmt::queryUint(unsigned &dst)
     return !bindArray()->is_null_value;
 }
 
+C_MyRoundTripScope::C_MyRoundTripScope(const char *name) noexcept:
+    m_outer(t_roundTripScope),
+    m_name(name)
+{
+    t_roundTripScope = this;
+}
+
+C_MyRoundTripScope::~C_MyRoundTripScope()
+{
+    t_roundTripScope = m_outer;
+}
+
+/*! \param [in] maxBytes Max bytes of any single result or blob
+    \param [in] action What query(..., MYSQL_STORE_RESULT) does about the cap
+*/
+C_MyMemoryCap::C_MyMemoryCap(size_t maxBytes, E_MyCapAction action) noexcept:
+    m_outer(t_memoryCap),
+    m_maxBytes(maxBytes),
+    m_action(action)
+{
+    t_memoryCap = this;
+}
+
+C_MyMemoryCap::~C_MyMemoryCap()
+{
+    t_memoryCap = m_outer;
+}
+
+void C_MyMemoryCap::check(size_t bytes, const std::string &what) const
+{
+    if (bytes > m_maxBytes)
+        RUNTIME_ERROR("{}", capError(what, m_maxBytes));
+}
+
+const C_MyMemoryCap *C_MyMemoryCap::current() noexcept
+{
+    return t_memoryCap;
+}
+
 C_LockTablesTillEnd::C_LockTablesTillEnd(C_MySQL &mysql):
     m_mysql(mysql),
     m_state(LS_NONE)
@@ -579,19 +1463,41 @@ C_LockTablesTillEnd::C_LockTablesTillEnd(C_MySQL &mysql):
 
 void C_LockTablesTillEnd::addRead(const std::string &table)
 {
-    m_spec[table] = "read";
+    m_spec[table] = LM_READ;
 }
 
 void C_LockTablesTillEnd::addWrite(const std::string &table)
 {
-    m_spec[table] = "write";
+    m_spec[table] = LM_WRITE;
+}
+
+MYSQL *C_LockTablesTillEnd::holder()
+/*! \brief Get the connection, forgetting the locks held if it has been reconnected since they were taken
+*/
+{
+    MYSQL *const ret = m_mysql;
+    if (m_state != LS_NONE && mysql_thread_id(ret) != m_threadId)
+    {
+        // Locks are gone along with the old connection
+        m_held.clear();
+        m_state = LS_NONE;
+    }
+    return ret;
 }
 
 void C_LockTablesTillEnd::lock()
+/*! \brief Lock tables as specified, or do nothing if they are already so locked by the same connection
+
+    <tt>LOCK TABLES</tt> implicitly releases all tables held, so any change of the spec costs a full relock.
+*/
 {
     if (m_spec.empty())
         return unlock();
 
+    MYSQL *const mysql = holder();
+    if (m_state == LS_BY_SPEC && m_held == m_spec)
+        return;
+
     std::string sql;
     for (auto &i: m_spec)
     {
@@ -600,17 +1506,23 @@ void C_LockTablesTillEnd::lock()
         else
             sql += ", ";
 
-        sql.append(i.first).append(1, ' ').append(i.second);
+        sql.append(i.first).append(i.second == LM_WRITE? " write": " read");
     }
-    query(m_mysql, sql);
+    m_held.clear();
+    m_state = LS_NONE; // Previous locks are gone even if this fails
+    timedLock(mysql, sql);
+    m_held = m_spec;
     m_state = LS_BY_SPEC;
 }
 
 void C_LockTablesTillEnd::lockAllRead()
 {
+    MYSQL *const mysql = holder();
     if (m_state != LS_ALL_READ)
     {
-        query(m_mysql, "FLUSH TABLES WITH READ LOCK");
+        m_held.clear();
+        m_state = LS_NONE;
+        timedLock(mysql, "FLUSH TABLES WITH READ LOCK");
         m_state = LS_ALL_READ;
     }
 }
@@ -630,8 +1542,110 @@ void C_LockTablesTillEnd::unlock()
     if (m_state != LS_NONE)
     {
         query(m_mysql, "unlock tables");
+        m_held.clear();
         m_state = LS_NONE;
     }
 }
 
+void C_LockTablesTillEnd::timedLock(MYSQL *mysql, const std::string &sql)
+/*! \brief Run lock statement \a sql once, timing it into tableLockStats() and recording the locking connection.
+    Lock wait timeouts and deadlocks are not retried but thrown, and so counted as failures.
+*/
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto ret = tryQuery(mysql, sql);
+    tableLockStats().add(std::chrono::steady_clock::now() - start, ret.has_value());
+    if (!ret)
+        RUNTIME_ERROR("{}", ret.error().m_what);
+
+    m_threadId = mysql_thread_id(mysql);
+}
+
+C_MyAdvisoryLock::C_MyAdvisoryLock(C_MySQL &mysql, std::string name, std::chrono::milliseconds timeout):
+    C_MyAdvisoryLock(mysql, std::vector<std::string>{std::move(name)}, timeout)
+{
+}
+
+/*! \param [in] mysql Connection to own the locks
+    \param [in] names Lock names, in any order and possibly duplicate
+    \param [in] timeout Max wait of each lock
+*/
+C_MyAdvisoryLock::C_MyAdvisoryLock(C_MySQL &mysql, std::vector<std::string> names, std::chrono::milliseconds timeout):
+    m_mysql(mysql)
+{
+    std::ranges::sort(names);
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    if (names.empty())
+        return;
+
+    MYSQL *const conn = m_mysql;
+    const auto secs = std::format("{:.3f}", std::chrono::duration<double>(timeout).count());
+    std::string sql = "select ";
+    for (auto &i: names)
+    {
+        if (&i != &names.front())
+            sql += ',';
+
+        sql.append("get_lock(").append(quotedSql(conn, i)).append(1, ',').append(secs) += ')';
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const std::string *failed{};
+    {
+        const auto res = query(conn, sql, MYSQL_STORE_RESULT);
+        const auto row = mysql_fetch_row(res);
+        if (!row)
+            RUNTIME_ERROR("No row of \"{}\"{}", sql, errorSuffix(conn));
+
+        for (size_t i = 0; i < names.size(); ++i)
+            if (row[i] && row[i][0] == '1')
+                m_names.emplace_back(names[i]);
+            else if (!failed)
+                failed = &names[i];
+    }
+    advisoryLockStats().add(std::chrono::steady_clock::now() - start, !failed);
+    if (failed)
+    {
+        unlock();
+        RUNTIME_ERROR("Timeout or error on get_lock({})", *failed);
+    }
+}
+
+C_MyAdvisoryLock::~C_MyAdvisoryLock()
+{
+    try
+    {
+        unlock();
+    }
+    catch (...)
+    {
+        // Locks are released anyway when the connection closes
+    }
+}
+
+void C_MyAdvisoryLock::unlock()
+{
+    if (m_names.empty())
+        return;
+
+    const auto names = std::move(m_names);
+    m_names.clear();
+    MYSQL *const conn = m_mysql;
+    std::string sql = "select ";
+    for (auto &i: names)
+    {
+        if (&i != &names.front())
+            sql += ',';
+
+        sql.append("release_lock(").append(quotedSql(conn, i)) += ')';
+    }
+    const auto res = query(conn, sql, MYSQL_STORE_RESULT);
+}
+
+void C_MyLockStats::add(std::chrono::steady_clock::duration wait, bool acquired) noexcept
+{
+    (acquired? m_acquired: m_failed).fetch_add(1, std::memory_order_relaxed);
+    m_waitNs.fetch_add(static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count()),
+        std::memory_order_relaxed);
+}
+
 } // namespace bux
@@ -0,0 +1,25 @@
+﻿#include <bux/oo_mariadb_batch.h>
+#include <bux/XException.h> // RUNTIME_ERROR()
+
+namespace bux {
+
+//
+//      Functions
+//
+void createKeyTable(MYSQL *mysql, const std::string &keyType)
+/*! \brief (Re)create empty session temporary table <tt>bux_keys(k)</tt> for queryByKeys()
+*/
+{
+    query(mysql, "create or replace temporary table bux_keys(k "+keyType+" primary key)");
+}
+
+void setArraySize(MYSQL_STMT *stmt, size_t n)
+/*! \brief Set number of rows of column-wise array binding, or disable it by zero; requires MariaDB 10.2+
+*/
+{
+    const auto size = static_cast<unsigned>(n);
+    if (mysql_stmt_attr_set(stmt, STMT_ATTR_ARRAY_SIZE, &size))
+        RUNTIME_ERROR("Fail to set array size {}{}", n, errorSuffix(stmt));
+}
+
+} // namespace bux
@@ -0,0 +1,170 @@
+﻿#include <bux/oo_mariadb_binlog.h>
+#include <bux/oo_mariadb_cache.h>   // bux::invalidateAllCaches(), bux::invalidateCaches(), bux::notifyWriteSql()
+#include <bux/XException.h> // RUNTIME_ERROR()
+#include <mysql/mariadb_rpl.h>  // mariadb_rpl_*()
+#include <chrono>           // std::chrono::seconds
+#include <condition_variable>   // std::condition_variable_any
+#ifdef _WIN32
+#include <winsock2.h>       // shutdown()
+#else
+#include <sys/socket.h>     // shutdown()
+#endif
+#ifdef CLT_DEBUG_
+#include <bux/Logger.h>     // LOG()
+#endif
+
+namespace {
+
+//
+//      In-Module Constants
+//
+#ifdef _WIN32
+constexpr int SHUT_RDWR = SD_BOTH;
+#endif
+
+} // namespace
+
+namespace bux {
+
+//
+//      Implement Classes
+//
+C_MyBinlogInvalidator::C_MyBinlogInvalidator(const C_MySQL &connProto, unsigned serverId):
+    m_tail(connProto.dup()),
+    m_serverId(serverId),
+    m_thread([this](std::stop_token stop){ run(stop); })
+{
+}
+
+C_MyBinlogInvalidator::~C_MyBinlogInvalidator()
+{
+    m_thread.request_stop();
+    while (!m_done)
+    {
+        // mariadb_rpl_fetch() blocks until next event, and tailing may be just (re)starting
+        shutdownTail();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+}
+
+std::string C_MyBinlogInvalidator::lastError() const
+{
+    std::lock_guard _{m_errorLock};
+    return m_lastError;
+}
+
+void C_MyBinlogInvalidator::run(std::stop_token stop)
+{
+    // Released by the destructor however this returns
+    struct C_Done
+    {
+        std::atomic<bool> &m_done;
+        ~C_Done() { m_done = true; }
+    } done{m_done};
+    std::mutex lock;
+    std::condition_variable_any cv;
+    while (!stop.stop_requested())
+    {
+        try
+        {
+            tail(stop);
+        }
+        catch (const std::exception &e)
+        {
+#ifdef CLT_DEBUG_
+            LOG(LL_ERROR, "Binlog tailing: {}", e.what());
+#endif
+            std::lock_guard _{m_errorLock};
+            m_lastError = e.what();
+        }
+        setTailing(nullptr, stop);
+        m_tail.disconnect();
+        invalidateAllCaches();
+
+        std::unique_lock lk{lock};
+        cv.wait_for(lk, stop, std::chrono::seconds(1), []{ return false; });
+    }
+}
+
+bool C_MyBinlogInvalidator::setTailing(MYSQL *mysql, std::stop_token stop)
+/*! \brief Let the destructor know the socket of \a mysql, or forget it if \a mysql is null
+    \return false if already stopped, because the destructor may have missed the socket
+*/
+{
+    std::lock_guard _{m_socketLock};
+    if (mysql)
+        m_tailSocket = mysql_get_socket(mysql);
+
+    m_tailing = mysql != nullptr;
+    return !stop.stop_requested();
+}
+
+void C_MyBinlogInvalidator::shutdownTail()
+/*! \brief Fail any blocking read or write on the tailing connection, which is then reconnected unless stopped
+*/
+{
+    std::lock_guard _{m_socketLock};
+    if (m_tailing)
+        shutdown(m_tailSocket, SHUT_RDWR);
+}
+
+void C_MyBinlogInvalidator::tail(std::stop_token stop)
+{
+    MYSQL *const mysql = m_tail.mysql();
+    if (!setTailing(mysql, stop))
+        return;
+
+    query(mysql, "SET @mariadb_slave_capability=4, @master_binlog_checksum=@@global.binlog_checksum");
+
+    std::string file;
+    unsigned long pos;
+    {
+        const auto res = query(mysql, "SHOW MASTER STATUS", MYSQL_STORE_RESULT);
+        const auto row = mysql_fetch_row(res);
+        if (!row || !row[0] || !row[1])
+            RUNTIME_ERROR("Binary log is not enabled");
+
+        file = row[0];
+        pos = strtoul(row[1], nullptr, 10);
+    }
+    // Changes before the position are unknown
+    invalidateAllCaches();
+
+    const std::unique_ptr<MARIADB_RPL,void(*)(MARIADB_RPL*)> rpl{mariadb_rpl_init(mysql), mariadb_rpl_close};
+    if (!rpl)
+        RUNTIME_ERROR("Fail to init replication{}", errorSuffix(mysql));
+
+    if (mariadb_rpl_optionsv(rpl.get(), MARIADB_RPL_FILENAME, file.c_str(), file.size()) ||
+        mariadb_rpl_optionsv(rpl.get(), MARIADB_RPL_START, pos) ||
+        mariadb_rpl_optionsv(rpl.get(), MARIADB_RPL_SERVER_ID, m_serverId) ||
+        mariadb_rpl_open(rpl.get()))
+        RUNTIME_ERROR("Fail to open binlog {}:{}{}", file, pos, errorSuffix(mysql));
+
+    if (!setTailing(mysql, stop))
+        // In case of reconnection in between
+        return;
+
+    MARIADB_RPL_EVENT *event{};
+    while (!stop.stop_requested() && (event = mariadb_rpl_fetch(rpl.get(), event)))
+    {
+        ++m_events;
+        switch (event->event_type)
+        {
+        case TABLE_MAP_EVENT:
+            // Precedes every batch of row events in ROW or MIXED format
+            invalidateCaches({event->event.table_map.table.str, event->event.table_map.table.length});
+            break;
+        case QUERY_EVENT:
+            // DDL or DML in STATEMENT format
+            notifyWriteSql({event->event.query.statement.str, event->event.query.statement.length});
+            break;
+        default:;
+        }
+    }
+    if (event)
+        mariadb_free_rpl_event(event);
+    else if (!stop.stop_requested())
+        RUNTIME_ERROR("Binlog tailing broken{}", errorSuffix(mysql));
+}
+
+} // namespace bux
@@ -0,0 +1,472 @@
+﻿#include <bux/oo_mariadb_cache.h>
+#include <bux/oo_mariadb_sql.h> // bux::isCallSql(), bux::isCommitSql(), bux::isWriteSql(), bux::normalizeSql(), bux::sqlTables()
+#include <bux/XException.h> // LOGIC_ERROR()
+#include <cctype>           // tolower()
+#include <unordered_set>    // std::unordered_set<>
+
+namespace {
+
+//
+//      In-Module Types
+//
+struct C_Uncommitted
+/// \brief Tables written by the current thread since its last COMMIT, to be invalidated again by the COMMIT
+{
+    std::unordered_set<std::string> m_tables;
+    bool                            m_all{};    // Tables unknown
+};
+
+//
+//      In-Module Data
+//
+constinit std::atomic<size_t> g_cacheCount{0};
+constinit std::atomic<size_t> g_allEpoch{0};    // Bumped by invalidateAllCaches()
+thread_local C_Uncommitted t_uncommitted;
+
+//
+//      In-Module Functions
+//
+size_t approxBytes(const bux::C_MyRowSet &rows)
+{
+    size_t ret = sizeof rows;
+    for (auto &i: rows.m_fields)
+        ret += sizeof i + i.size();
+    for (auto &i: rows.m_rows)
+    {
+        ret += sizeof i;
+        for (auto &j: i)
+            ret += sizeof j + (j? j->size(): 0);
+    }
+    return ret;
+}
+
+size_t fixedParamSize(enum_field_types type)
+{
+    switch (type)
+    {
+    case MYSQL_TYPE_TINY:
+        return 1;
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_YEAR:
+        return 2;
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_FLOAT:
+        return 4;
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_DOUBLE:
+        return 8;
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+        return sizeof(MYSQL_TIME);
+    default:
+        return 0;
+    }
+}
+
+std::string lower(std::string_view s)
+{
+    std::string ret(s);
+    for (auto &c: ret)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return ret;
+}
+
+auto &registry()
+{
+    static std::vector<bux::C_MyQueryCache*> caches;
+    return caches;
+}
+
+auto &registryLock()
+{
+    static std::mutex lock;
+    return lock;
+}
+
+std::string_view currentDb(MYSQL *mysql) noexcept
+{
+    return mysql && mysql->db? mysql->db: "";
+}
+
+bool inTransaction(MYSQL *mysql) noexcept
+{
+    return mysql && (mysql->server_status & SERVER_STATUS_IN_TRANS);
+}
+
+std::string readKey(MYSQL *mysql, const std::string &sql)
+{
+    if (bux::isWriteSql(sql))
+        LOGIC_ERROR("Not a read \"{}\"", sql);
+
+    return bux::cacheKey(currentDb(mysql), sql, nullptr, 0);
+}
+
+std::string readKey(bux::C_MySqlStmt &stmt, const std::string &sql, const std::function<void(MYSQL_BIND *barr)> &binder)
+{
+    if (bux::isWriteSql(sql))
+        LOGIC_ERROR("Not a read \"{}\"", sql);
+
+    const auto n = bux::countSqlPlaceholders(sql);
+    std::vector<MYSQL_BIND> params(n);
+    if (n)
+        binder(params.data());
+
+    return bux::cacheKey(currentDb(static_cast<MYSQL_STMT*>(stmt)->mysql), sql, params.data(), n);
+}
+
+std::shared_ptr<const bux::C_MyRowSet> execRows(bux::C_MySqlStmt &stmt, const std::string &sql,
+    const std::function<void(MYSQL_BIND *barr)> &binder)
+{
+    if (stmt.sql() != sql)
+        stmt.prepare(sql);
+    if (bux::countSqlPlaceholders(sql))
+        stmt.bindParams(binder);
+
+    return std::make_shared<const bux::C_MyRowSet>(stmt.execFetchRows());
+}
+
+} // namespace
+
+namespace bux {
+
+//
+//      Functions
+//
+std::string cacheKey(std::string_view db, std::string_view sql, const MYSQL_BIND *params, size_t count)
+/*! \return Default database \a db and normalized \a sql followed by the type, nullness and raw bytes of
+    each bound parameter, so that the same unqualified table names in different databases never collide
+*/
+{
+    std::string ret{db};
+    ret += '\0';
+    ret += normalizeSql(sql);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto &b = params[i];
+        ret += '\0';
+        ret += static_cast<char>(b.buffer_type);
+        if (b.buffer_type == MYSQL_TYPE_NULL || b.is_null && *b.is_null)
+        {
+            ret += 'N';
+            continue;
+        }
+        ret += b.is_unsigned? 'U': 'S';
+        size_t bytes = fixedParamSize(b.buffer_type);
+        if (!bytes)
+            bytes = b.length? *b.length: b.buffer_length;
+
+        ret.append(reinterpret_cast<const char*>(&bytes), sizeof bytes);
+        if (bytes && b.buffer)
+            ret.append(static_cast<const char*>(b.buffer), bytes);
+    }
+    return ret;
+}
+
+void invalidateAllCaches() noexcept
+/*! \brief Invalidate all live C_MyQueryCache instances, each applying it upon its next access.
+    Lock-free and so safe to call from failure paths.
+*/
+{
+    g_allEpoch.fetch_add(1, std::memory_order_release);
+}
+
+void invalidateCaches(std::string_view table)
+/*! \brief Invalidate all live C_MyQueryCache instances by \a table
+*/
+{
+    std::lock_guard _{registryLock()};
+    for (auto i: registry())
+        i->invalidate(table);
+}
+
+void notifyWriteSql(std::string_view sql) noexcept
+/*! \brief Invalidate all live C_MyQueryCache instances by tables referenced by \a sql, if \a sql is a write.
+    Called by query() and C_MySqlStmt::exec() upon success; costs an atomic load when no cache is alive.
+
+    Tables written are invalidated again by the next COMMIT issued by the same thread, because reads by other
+    connections may have cached the committed rows in between. A stored procedure call invalidates all.
+*/
+{
+    if (!g_cacheCount.load(std::memory_order_relaxed) || sql.empty())
+        return;
+
+    auto &uncommitted = t_uncommitted;
+    try
+    {
+        if (isWriteSql(sql))
+        {
+            auto tables = sqlTables(sql);
+            if (tables.empty() || isCallSql(sql))
+            {
+                invalidateAllCaches();
+                uncommitted.m_all = true;
+            }
+            else for (auto &i: tables)
+            {
+                invalidateCaches(i);
+                uncommitted.m_tables.emplace(std::move(i));
+            }
+        }
+        if (isCommitSql(sql))
+        {
+            if (uncommitted.m_all)
+                invalidateAllCaches();
+            else for (auto &i: uncommitted.m_tables)
+                invalidateCaches(i);
+
+            uncommitted = {};
+        }
+    }
+    catch (...)
+    {
+        invalidateAllCaches();
+        uncommitted = {};
+    }
+}
+
+//
+//      Implement Classes
+//
+C_MyQueryCache::C_MyQueryCache(): C_MyQueryCache(C_Options{})
+{
+}
+
+C_MyQueryCache::C_MyQueryCache(const C_Options &opts): m_opts(opts), m_epoch(g_allEpoch.load(std::memory_order_acquire))
+{
+    std::lock_guard _{registryLock()};
+    registry().emplace_back(this);
+    g_cacheCount.fetch_add(1);
+}
+
+C_MyQueryCache::~C_MyQueryCache()
+{
+    std::lock_guard _{registryLock()};
+    auto &r = registry();
+    std::erase(r, this);
+    g_cacheCount.fetch_sub(1);
+}
+
+void C_MyQueryCache::erase(std::unordered_map<std::string,C_Entry>::iterator it)
+{
+    for (auto &i: it->second.m_tables)
+        if (auto found = m_byTable.find(i); found != m_byTable.end())
+        {
+            found->second.erase(it->first);
+            if (found->second.empty())
+                m_byTable.erase(found);
+        }
+
+    m_lru.erase(it->second.m_lru);
+    m_bytes -= it->second.m_bytes;
+    m_entries.erase(it);
+}
+
+std::shared_ptr<const C_MyRowSet> C_MyQueryCache::find(const std::string &key)
+{
+    std::lock_guard _{m_lock};
+    syncEpoch();
+    if (auto it = m_entries.find(key); it != m_entries.end())
+    {
+        if (m_opts.m_ttl.count() && it->second.m_expiry <= std::chrono::steady_clock::now())
+            erase(it);
+        else
+        {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.m_lru);
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return it->second.m_rows;
+        }
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    return {};
+}
+
+void C_MyQueryCache::insert(const std::string &key, std::string_view sql, std::shared_ptr<const C_MyRowSet> rows, size_t generation)
+{
+    const auto bytes = approxBytes(*rows);
+    if (bytes > m_opts.m_maxBytes || !m_opts.m_maxEntries)
+        return;
+
+    auto tables = sqlTables(sql);
+    std::lock_guard _{m_lock};
+    syncEpoch();
+    if (generation != m_generation)
+        // Invalidated while being fetched
+        return;
+
+    if (auto it = m_entries.find(key); it != m_entries.end())
+        erase(it);
+
+    m_lru.emplace_front(key);
+    for (auto &i: tables)
+        m_byTable[i].emplace(key);
+
+    m_entries.emplace(key, C_Entry{
+        std::move(rows),
+        std::chrono::steady_clock::now() + m_opts.m_ttl,
+        bytes,
+        std::move(tables),
+        m_lru.begin()});
+    m_bytes += bytes;
+    while (m_entries.size() > m_opts.m_maxEntries || m_bytes > m_opts.m_maxBytes)
+        erase(m_entries.find(m_lru.back()));
+}
+
+void C_MyQueryCache::invalidate(std::string_view table)
+/*! \param [in] table Unqualified table name, case-insensitive
+*/
+{
+    const auto name = lower(table);
+    std::lock_guard _{m_lock};
+    ++m_generation;
+    if (auto found = m_byTable.find(name); found != m_byTable.end())
+    {
+        const auto keys = std::move(found->second);
+        m_byTable.erase(found);
+        for (auto &i: keys)
+            if (auto it = m_entries.find(i); it != m_entries.end())
+                erase(it);
+    }
+}
+
+void C_MyQueryCache::invalidateAll()
+{
+    std::lock_guard _{m_lock};
+    ++m_generation;
+    m_entries.clear();
+    m_byTable.clear();
+    m_lru.clear();
+    m_bytes = 0;
+}
+
+void C_MyQueryCache::syncEpoch()
+/*! \brief Apply invalidateAllCaches() called since the last time, with m_lock held
+*/
+{
+    if (const auto epoch = g_allEpoch.load(std::memory_order_acquire); epoch != m_epoch)
+    {
+        m_epoch = epoch;
+        ++m_generation;
+        m_entries.clear();
+        m_byTable.clear();
+        m_lru.clear();
+        m_bytes = 0;
+    }
+}
+
+std::shared_ptr<const C_MyRowSet> C_MyQueryCache::query(MYSQL *mysql, const std::string &sql)
+{
+    const auto key = readKey(mysql, sql);
+    if (inTransaction(mysql))
+        return std::make_shared<const C_MyRowSet>(queryRows(mysql, sql));
+
+    if (auto ret = find(key))
+        return ret;
+
+    return m_flight.run(key, [&]{
+        const auto generation = this->generation();
+        auto ret = std::make_shared<const C_MyRowSet>(queryRows(mysql, sql));
+        insert(key, sql, ret, generation);
+        return ret;
+    });
+}
+
+std::shared_ptr<const C_MyRowSet> C_MyQueryCache::query(C_MySqlStmt &stmt, const std::string &sql,
+    const std::function<void(MYSQL_BIND *barr)> &binder)
+/*! \param [in] stmt Prepared again only if its current SQL differs from \a sql
+    \param [in] sql Read statement with '?' placeholders
+    \param [in] binder Called once more to bind the actual parameters on cache miss
+*/
+{
+    const auto key = readKey(stmt, sql, binder);
+    if (inTransaction(static_cast<MYSQL_STMT*>(stmt)->mysql))
+        return execRows(stmt, sql, binder);
+
+    if (auto ret = find(key))
+        return ret;
+
+    return m_flight.run(key, [&]{
+        const auto generation = this->generation();
+        auto ret = execRows(stmt, sql, binder);
+        insert(key, sql, ret, generation);
+        return ret;
+    });
+}
+
+size_t C_MyQueryCache::generation() const
+{
+    std::lock_guard _{m_lock};
+    return m_generation;
+}
+
+C_MyQueryCache::C_Stats C_MyQueryCache::stats() const
+{
+    std::lock_guard _{m_lock};
+    if (g_allEpoch.load(std::memory_order_acquire) != m_epoch)
+        // Not yet applied invalidateAllCaches()
+        return {m_hits.load(), m_misses.load(), 0, 0};
+
+    return {m_hits.load(), m_misses.load(), m_entries.size(), m_bytes};
+}
+
+std::shared_ptr<const C_MyRowSet> C_MySingleFlight::query(MYSQL *mysql, const std::string &sql)
+{
+    auto key = readKey(mysql, sql);
+    auto fetch = [&]{
+        return std::make_shared<const C_MyRowSet>(queryRows(mysql, sql));
+    };
+    return inTransaction(mysql)? fetch(): run(key, fetch);
+}
+
+std::shared_ptr<const C_MyRowSet> C_MySingleFlight::query(C_MySqlStmt &stmt, const std::string &sql,
+    const std::function<void(MYSQL_BIND *barr)> &binder)
+/*! \param [in] stmt Prepared again only if its current SQL differs from \a sql
+    \param [in] sql Read statement with '?' placeholders
+    \param [in] binder Called once more to bind the actual parameters if this call is the leader
+*/
+{
+    auto key = readKey(stmt, sql, binder);
+    auto fetch = [&]{
+        return execRows(stmt, sql, binder);
+    };
+    return inTransaction(static_cast<MYSQL_STMT*>(stmt)->mysql)? fetch(): run(key, fetch);
+}
+
+std::shared_ptr<const C_MyRowSet> C_MySingleFlight::run(const std::string &key,
+    const std::function<std::shared_ptr<const C_MyRowSet>()> &fetch)
+/*! \brief The first caller of \a key runs \a fetch while later callers of the same \a key wait for
+    and share its result, or its exception.
+*/
+{
+    std::promise<std::shared_ptr<const C_MyRowSet>> leader;
+    {
+        std::unique_lock lk{m_lock};
+        if (auto found = m_inflight.find(key); found != m_inflight.end())
+        {
+            auto follower = found->second;
+            lk.unlock();
+            m_coalesced.fetch_add(1, std::memory_order_relaxed);
+            return follower.get();
+        }
+        m_inflight.emplace(key, leader.get_future().share());
+    }
+    try
+    {
+        auto ret = fetch();
+        leader.set_value(ret);
+        std::lock_guard _{m_lock};
+        m_inflight.erase(key);
+        return ret;
+    }
+    catch (...)
+    {
+        leader.set_exception(std::current_exception());
+        std::lock_guard _{m_lock};
+        m_inflight.erase(key);
+        throw;
+    }
+}
+
+} // namespace bux
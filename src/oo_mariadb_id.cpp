@@ -0,0 +1,150 @@
+﻿#include <bux/oo_mariadb_id.h>
+#include <bux/XException.h> // LOGIC_ERROR(), RUNTIME_ERROR()
+#include <algorithm>        // std::max()
+#include <chrono>           // std::chrono::seconds
+
+namespace bux {
+
+//
+//      Implement Classes
+//
+C_MyIdAllocator::C_MyIdAllocator(const C_MySQL &connProto, E_MyIdSource source, std::string name):
+    C_MyIdAllocator(connProto, source, std::move(name), C_Options{})
+{
+}
+
+/*! \param [in] connProto Connection prototype to dup() from
+    \param [in] source Kind of \a name
+    \param [in] name Name of the SEQUENCE object or of the table
+    \param [in] opts Block size and prefetch depth
+*/
+C_MyIdAllocator::C_MyIdAllocator(const C_MySQL &connProto, E_MyIdSource source, std::string name, const C_Options &opts):
+    m_mysql(connProto.dup()),
+    m_source(source),
+    m_name(std::move(name)),
+    m_opts{std::max<uint64_t>(opts.m_blockSize, 1), opts.m_prefetch},
+    m_ringSize(opts.m_prefetch + 3),
+    m_ring(std::make_unique<C_Slot[]>(m_ringSize)),
+    m_refiller([this](std::stop_token stop){ refill(stop); })
+{
+}
+
+C_MyIdAllocator::~C_MyIdAllocator()
+{
+    m_refiller.request_stop();
+    m_refiller.join();
+}
+
+uint64_t C_MyIdAllocator::next()
+{
+    const auto B = m_opts.m_blockSize;
+    for (;;)
+    {
+        const auto ticket = m_ticket.fetch_add(1, std::memory_order_relaxed);
+        const auto block = ticket / B;
+        if (ticket % B == 0 && ticket)
+        {
+            // Entering a new block: wake the refiller to keep ahead
+            {
+                std::lock_guard _{m_lock};
+            }
+            m_cv.notify_all();
+        }
+        auto &slot = m_ring[block % m_ringSize];
+        for (;;)
+        {
+            // Seqlock read
+            const auto b1 = slot.m_block.load(std::memory_order_acquire);
+            if (b1 == block + 1)
+            {
+                const auto base = slot.m_base.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.m_block.load(std::memory_order_relaxed) == b1)
+                    return base + ticket % B;
+            }
+            else if (!waitBlock(block))
+                // Too slow to read it before the slot was reused; draw another ticket
+                break;
+        }
+    }
+}
+
+void C_MyIdAllocator::refill(std::stop_token stop)
+{
+    std::unique_lock lk{m_lock};
+    for (;;)
+    {
+        m_cv.wait(lk, stop, [this]{
+            return m_filled <= m_ticket.load(std::memory_order_relaxed) / m_opts.m_blockSize + m_opts.m_prefetch;
+        });
+        if (stop.stop_requested())
+            return;
+
+        lk.unlock();
+        std::string error;
+        uint64_t base{};
+        try
+        {
+            base = reserveBlock();
+        }
+        catch (const std::exception &e)
+        {
+            error = e.what();
+        }
+        lk.lock();
+        if (error.empty())
+        {
+            // Seqlock write
+            auto &slot = m_ring[m_filled % m_ringSize];
+            slot.m_block.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.m_base.store(base, std::memory_order_relaxed);
+            slot.m_block.store(++m_filled, std::memory_order_release);
+            m_cv.notify_all();
+        }
+        else
+        {
+            m_lastError = std::move(error);
+            ++m_failures;
+            m_cv.notify_all();
+            m_cv.wait_for(lk, stop, std::chrono::seconds(1), []{ return false; });
+        }
+    }
+}
+
+uint64_t C_MyIdAllocator::reserveBlock()
+/*! \return Base of a new block reserved by one statement
+*/
+{
+    const auto B = m_opts.m_blockSize;
+    switch (m_source)
+    {
+    case MYID_SEQUENCE:
+        return queryULong(m_mysql, "select nextval("+m_name+')') * B;
+    case MYID_TABLE:
+        {
+            MYSQL *const mysql = m_mysql;
+            affect(mysql, std::format("update {} set next_id=last_insert_id(next_id+{})", m_name, B));
+            return mysql_insert_id(mysql) - B;
+        }
+    default:
+        LOGIC_ERROR("Unknown id source {}", static_cast<int>(m_source));
+    }
+}
+
+bool C_MyIdAllocator::waitBlock(uint64_t block)
+/*! \retval true Block \a block has been published
+    \retval false Block \a block has been overwritten by a later one
+*/
+{
+    std::unique_lock lk{m_lock};
+    m_cv.notify_all();
+    const auto failures = m_failures;
+    m_cv.wait(lk, [&]{ return m_filled > block || m_failures != failures; });
+    if (m_filled <= block)
+        RUNTIME_ERROR("Fail to reserve ids from {}: {}", m_name, m_lastError);
+
+    return m_ring[block % m_ringSize].m_block.load(std::memory_order_acquire) == block + 1;
+}
+
+} // namespace bux
@@ -0,0 +1,310 @@
+﻿#include <bux/oo_mariadb_jobqueue.h>
+#include <bux/XException.h> // RUNTIME_ERROR()
+#include <algorithm>        // std::max(), std::min()
+#include <condition_variable>   // std::condition_variable_any
+#include <deque>            // std::deque<>
+#include <format>           // std::format()
+#include <thread>           // std::jthread
+
+namespace {
+
+//
+//      In-Module Functions
+//
+void queryAll(MYSQL *mysql, const std::string &sql)
+/*! \brief Run multiple statements \a sql and throw if any of them fails, not just the first one
+*/
+{
+    bux::query(mysql, sql);
+    for (int status; mysql_free_result(mysql_use_result(mysql)), (status = mysql_next_result(mysql)) != -1;)
+        if (status > 0)
+            RUNTIME_ERROR("Query \"{}\"{}", sql, bux::errorSuffix(mysql));
+}
+
+} // namespace
+
+namespace bux {
+
+//
+//      Implement Classes
+//
+C_MyJobQueue::C_MyJobQueue(const C_MySQL &connProto, C_Schema schema):
+    C_MyJobQueue(connProto, std::move(schema), C_Options{})
+{
+}
+
+/*! \param [in] connProto Connection prototype to dup() from
+    \param [in] schema Queue table and the meaning of its state column
+    \param [in] opts Batching options
+*/
+C_MyJobQueue::C_MyJobQueue(const C_MySQL &connProto, C_Schema schema, const C_Options &opts):
+    m_mysql(connProto.dup()),
+    m_schema(std::move(schema)),
+    m_opts(opts)
+{
+}
+
+void C_MyJobQueue::ack(unsigned long long id)
+/*! \brief Mark job \a id as done by the next flushAcks()
+*/
+{
+    std::lock_guard _{m_ackLock};
+    m_acks.emplace_back(id);
+}
+
+std::vector<C_MyJob> C_MyJobQueue::claim(size_t max)
+/*! \brief Claim at most \a max ready jobs skipping those locked by other consumers
+*/
+{
+    std::vector<C_MyJob> ret;
+    if (!max)
+        return ret;
+
+    const auto &s = m_schema;
+    std::lock_guard _{m_connLock};
+    MYSQL *const mysql = m_mysql;
+    query(mysql, std::format("start transaction;select {}{}{} from {} where {}={} order by {} limit {} for update skip locked",
+        s.m_idColumn, s.m_fields.empty()? "": ",", s.m_fields, s.m_table, s.m_stateColumn, s.m_ready, s.m_idColumn, max));
+    try
+    {
+        if (mysql_next_result(mysql))
+            RUNTIME_ERROR("Claim jobs from {}{}", s.m_table, errorSuffix(mysql));
+
+        {
+            const C_MySqlResult res = mysql_store_result(mysql);
+            if (!res)
+                RUNTIME_ERROR("No claimed jobs from {}{}", s.m_table, errorSuffix(mysql));
+
+            const auto n = mysql_num_fields(res);
+            while (auto row = mysql_fetch_row(res))
+            {
+                const auto lengths = mysql_fetch_lengths(res);
+                auto &job = ret.emplace_back();
+                job.m_id = strtoull(row[0], nullptr, 10);
+                for (unsigned i = 1; i < n; ++i)
+                    if (row[i])
+                        job.m_fields.emplace_back(std::in_place, row[i], lengths[i]);
+                    else
+                        job.m_fields.emplace_back();
+            }
+        }
+        if (ret.empty())
+            query(mysql, "commit");
+        else
+        {
+            std::vector<unsigned long long> ids;
+            ids.reserve(ret.size());
+            for (auto &i: ret)
+                ids.emplace_back(i.m_id);
+
+            auto assignments = std::format("{}={}", s.m_stateColumn, s.m_claimed);
+            if (!s.m_attemptsColumn.empty())
+                assignments += std::format(",{0}={0}+1", s.m_attemptsColumn);
+
+            queryAll(mysql, setState(assignments, ids)+";commit");
+        }
+    }
+    catch (...)
+    {
+        try
+        {
+            query(mysql, "rollback");
+        }
+        catch (...)
+        {
+            // Connection is broken and so is the transaction
+        }
+        throw;
+    }
+    return ret;
+}
+
+void C_MyJobQueue::flushAcks()
+/*! \brief Mark acked jobs as done and nacked jobs as ready again, in one round trip
+*/
+{
+    std::vector<unsigned long long> acks, nacks;
+    {
+        std::lock_guard _{m_ackLock};
+        acks.swap(m_acks);
+        nacks.swap(m_nacks);
+    }
+    const auto &s = m_schema;
+    std::string sql;
+    if (!acks.empty())
+        sql = setState(std::format("{}={}", s.m_stateColumn, s.m_done), acks);
+    if (!nacks.empty())
+    {
+        if (!sql.empty())
+            sql += ';';
+
+        sql += setState(s.m_attemptsColumn.empty()?
+            std::format("{}={}", s.m_stateColumn, s.m_ready):
+            std::format("{}=if({}>={},{},{})", s.m_stateColumn, s.m_attemptsColumn, m_opts.m_maxAttempts, s.m_dead, s.m_ready),
+            nacks);
+    }
+    if (sql.empty())
+        return;
+
+    try
+    {
+        std::lock_guard _{m_connLock};
+        queryAll(m_mysql, sql);
+    }
+    catch (...)
+    {
+        std::lock_guard _{m_ackLock};
+        m_acks.insert(m_acks.end(), acks.begin(), acks.end());
+        m_nacks.insert(m_nacks.end(), nacks.begin(), nacks.end());
+        throw;
+    }
+}
+
+void C_MyJobQueue::nack(unsigned long long id)
+/*! \brief Return job \a id to ready state by the next flushAcks()
+*/
+{
+    std::lock_guard _{m_ackLock};
+    m_nacks.emplace_back(id);
+}
+
+void C_MyJobQueue::run(size_t workers, const F_Handler &handler, std::stop_token stop)
+/*! \brief Claim and dispatch jobs to \a workers threads until \a stop is requested.
+    \param [in] workers Number of worker threads
+    \param [in] handler Job is acked if it returns, or nacked if it throws
+    \param [in] stop Claimed jobs are still handled after stop is requested
+
+    Acks and nacks collected so far are flushed on return, and attempted to be flushed before any exception
+    is rethrown.
+
+    Batch size doubles, up to C_Options::m_maxBatch, when a full batch is claimed while workers are idle,
+    and halves, down to C_Options::m_minBatch, when less than half a batch is claimed.
+*/
+{
+    workers = std::max<size_t>(workers, 1);
+    std::mutex lock;
+    std::condition_variable_any cv;
+    std::deque<C_MyJob> queue;
+    size_t idle = 0;
+    bool done = false;
+    try
+    {
+        {
+            std::vector<std::jthread> pool;
+            for (size_t i = 0; i < workers; ++i)
+                pool.emplace_back([&] {
+                    std::unique_lock lk{lock};
+                    for (;;)
+                    {
+                        ++idle;
+                        cv.notify_all();
+                        cv.wait(lk, [&]{ return !queue.empty() || done; });
+                        --idle;
+                        if (queue.empty())
+                            return;
+
+                        const auto job = std::move(queue.front());
+                        queue.pop_front();
+                        lk.unlock();
+                        try
+                        {
+                            handler(job);
+                            ack(job.m_id);
+                        }
+                        catch (...)
+                        {
+                            nack(job.m_id);
+                        }
+                        lk.lock();
+                    }
+                });
+
+            struct C_Finish
+            {
+                std::mutex &m_lock;
+                std::condition_variable_any &m_cv;
+                bool &m_done;
+                ~C_Finish()
+                {
+                    {
+                        std::lock_guard _{m_lock};
+                        m_done = true;
+                    }
+                    m_cv.notify_all();
+                }
+            } finish{lock, cv, done}; // Let workers drain the queue and quit before joined
+
+            auto batch = std::clamp(m_opts.m_minBatch, size_t{1}, std::max<size_t>(m_opts.m_maxBatch, 1));
+            auto lastFlush = std::chrono::steady_clock::now();
+            while (!stop.stop_requested())
+            {
+                bool starving;
+                {
+                    std::unique_lock lk{lock};
+                    if (!cv.wait(lk, stop, [&]{ return queue.size() < workers; }))
+                        break;
+
+                    starving = queue.empty() && idle > 0;
+                }
+                auto jobs = claim(batch);
+                const auto claimed = jobs.size();
+                if (claimed == batch && starving)
+                    batch = std::min(batch * 2, std::max(m_opts.m_maxBatch, m_opts.m_minBatch));
+                else if (claimed < batch / 2)
+                    batch = std::max({batch / 2, m_opts.m_minBatch, size_t{1}});
+
+                if (claimed)
+                {
+                    {
+                        std::lock_guard _{lock};
+                        for (auto &i: jobs)
+                            queue.emplace_back(std::move(i));
+                    }
+                    cv.notify_all();
+                }
+                const auto now = std::chrono::steady_clock::now();
+                size_t acks;
+                {
+                    std::lock_guard _{m_ackLock};
+                    acks = m_acks.size() + m_nacks.size();
+                }
+                if (acks >= m_opts.m_ackBatch || now - lastFlush >= m_opts.m_ackInterval)
+                {
+                    flushAcks();
+                    lastFlush = now;
+                }
+                if (!claimed)
+                {
+                    std::unique_lock lk{lock};
+                    cv.wait_for(lk, stop, m_opts.m_idleWait, []{ return false; });
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        // Keep the outcomes of jobs already handled
+        try
+        {
+            flushAcks();
+        }
+        catch (...)
+        {
+            // Still pending for the next run()
+        }
+        throw;
+    }
+    flushAcks();
+}
+
+std::string C_MyJobQueue::setState(const std::string &assignments, const std::vector<unsigned long long> &ids) const
+{
+    auto ret = std::format("update {} set {} where {} in (", m_schema.m_table, assignments, m_schema.m_idColumn);
+    for (auto i: ids)
+        ret.append(std::to_string(i)) += ',';
+
+    ret.back() = ')';
+    return ret;
+}
+
+} // namespace bux
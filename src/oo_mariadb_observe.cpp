@@ -0,0 +1,224 @@
+﻿#include <bux/oo_mariadb_observe.h>
+#include <bux/oo_mariadb_sql.h>     // bux::fingerprintSql()
+#include <bux/XException.h> // RUNTIME_ERROR()
+#include <algorithm>        // std::ranges::sort()
+#include <bit>              // std::bit_width()
+#include <cmath>            // std::ceil()
+#include <mutex>            // std::unique_lock<>
+
+namespace {
+
+//
+//      In-Module Constants
+//
+constexpr size_t MAX_OBSERVERS = 8;
+
+//
+//      In-Module Data
+//
+std::atomic<bux::I_MyObserver*> g_observers[MAX_OBSERVERS]{};
+std::atomic<size_t>             g_observerCount{};
+thread_local const char         *t_callSite = "";
+
+} // namespace
+
+namespace bux {
+
+//
+//      Functions
+//
+void addObserver(I_MyObserver &obs)
+{
+    for (auto &i: g_observers)
+    {
+        I_MyObserver *expected{};
+        if (i.compare_exchange_strong(expected, &obs, std::memory_order_release))
+        {
+            g_observerCount.fetch_add(1, std::memory_order_release);
+            return;
+        }
+    }
+    RUNTIME_ERROR("More than {} observers", MAX_OBSERVERS);
+}
+
+void notifyOp(const C_MyOpEvent &ev) noexcept
+{
+    for (auto &i: g_observers)
+        if (const auto obs = i.load(std::memory_order_acquire))
+            obs->onOp(ev);
+}
+
+#ifndef BUX_MY_NO_OBSERVERS
+bool observing() noexcept
+{
+    return g_observerCount.load(std::memory_order_relaxed) > 0;
+}
+#endif
+
+void removeObserver(I_MyObserver &obs) noexcept
+/*! \brief Stop notifying \a obs, which must stay alive till operations in flight are done.
+*/
+{
+    for (auto &i: g_observers)
+    {
+        I_MyObserver *expected = &obs;
+        if (i.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel))
+        {
+            g_observerCount.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+//
+//      Implement Classes
+//
+C_MyCallSite::C_MyCallSite(const char *tag) noexcept: m_outer(t_callSite)
+{
+    t_callSite = tag;
+}
+
+C_MyCallSite::~C_MyCallSite()
+{
+    t_callSite = m_outer;
+}
+
+const char *C_MyCallSite::current() noexcept
+/*! \return Tag of the innermost C_MyCallSite alive in the current thread, or "" if none
+*/
+{
+    return t_callSite;
+}
+
+unsigned C_MyHistogram::bucketOf(uint64_t ns) noexcept
+{
+    if (ns < SUB_COUNT)
+        return static_cast<unsigned>(ns);
+
+    const auto shift = static_cast<unsigned>(std::bit_width(ns)) - 1 - SUB_BITS;
+    return (shift + 1) * SUB_COUNT + static_cast<unsigned>((ns >> shift) & (SUB_COUNT - 1));
+}
+
+uint64_t C_MyHistogram::lowerBound(unsigned bucket) noexcept
+{
+    if (bucket < SUB_COUNT)
+        return bucket;
+
+    return uint64_t(SUB_COUNT + bucket % SUB_COUNT) << (bucket / SUB_COUNT - 1);
+}
+
+uint64_t C_MyHistogram::percentile(double p) const noexcept
+/*! \param [in] p Percentage in [0,100]
+    \return Midpoint of the bucket where the \a p-th percentile falls, or 0 if nothing has been recorded
+*/
+{
+    const auto total = count();
+    if (!total)
+        return 0;
+
+    const auto rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(p / 100 * double(total))), 1);
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < BUCKETS; ++i)
+        if (sum += m_buckets[i].load(std::memory_order_relaxed); sum >= rank)
+        {
+            if (i < SUB_COUNT)
+                return i;
+
+            const auto lo = lowerBound(i);
+            return std::min(lo + (uint64_t(1) << (i / SUB_COUNT - 1)) / 2, max());
+        }
+
+    return max();
+}
+
+void C_MyHistogram::record(uint64_t ns) noexcept
+{
+    m_buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(ns, std::memory_order_relaxed);
+    for (auto old = m_max.load(std::memory_order_relaxed);
+         old < ns && !m_max.compare_exchange_weak(old, ns, std::memory_order_relaxed););
+}
+
+void C_MyHistogram::reset() noexcept
+{
+    for (auto &i: m_buckets)
+        i.store(0, std::memory_order_relaxed);
+
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+void C_MyLatencyByFingerprint::onOp(const C_MyOpEvent &ev) noexcept
+{
+    if (ev.m_op != MYOP_QUERY && ev.m_op != MYOP_EXEC)
+        return;
+
+    try
+    {
+        // Prepared statements are executed repeatedly with the same SQL
+        thread_local std::string lastSql, lastFingerprint;
+        if (ev.m_sql != lastSql)
+        {
+            lastFingerprint = fingerprintSql(ev.m_sql);
+            lastSql = ev.m_sql;
+        }
+        C_Entry *entry{};
+        {
+            std::shared_lock _{m_lock};
+            if (const auto found = m_entries.find(lastFingerprint); found != m_entries.end())
+                entry = found->second.get();
+        }
+        if (!entry)
+        {
+            std::unique_lock _{m_lock};
+            const auto &key = m_entries.size() < m_maxFingerprints? lastFingerprint: std::string{};
+            auto &slot = m_entries[key];
+            if (!slot)
+                slot = std::make_unique<C_Entry>();
+
+            entry = slot.get();
+        }
+        entry->m_latency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(ev.m_elapsed).count()));
+        if (ev.m_errno)
+            entry->m_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    catch (...)
+    {
+        // Out of memory: drop the sample
+    }
+}
+
+void C_MyLatencyByFingerprint::reset()
+/*! \brief Zero all histograms but keep the fingerprints, whose entries may be in use by other threads.
+*/
+{
+    std::shared_lock _{m_lock};
+    for (auto &i: m_entries)
+    {
+        i.second->m_latency.reset();
+        i.second->m_errors.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::vector<C_MyLatencyByFingerprint::C_Summary> C_MyLatencyByFingerprint::summary() const
+/*! \return Summaries sorted by total time descending
+*/
+{
+    std::vector<C_Summary> ret;
+    {
+        std::shared_lock _{m_lock};
+        ret.reserve(m_entries.size());
+        for (auto &i: m_entries)
+        {
+            const auto &h = i.second->m_latency;
+            ret.emplace_back(C_Summary{i.first, h.count(), i.second->m_errors.load(std::memory_order_relaxed),
+                h.sum(), h.percentile(50), h.percentile(99), h.max()});
+        }
+    }
+    std::ranges::sort(ret, [](auto &a, auto &b){ return a.m_totalNs > b.m_totalNs; });
+    return ret;
+}
+
+} // namespace bux
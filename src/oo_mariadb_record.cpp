@@ -0,0 +1,266 @@
+﻿#include <bux/oo_mariadb_record.h>
+#include <bux/XException.h> // RUNTIME_ERROR()
+#include <cstring>          // memcmp()
+
+namespace {
+
+//
+//      In-Module Constants
+//
+constexpr char MAGIC[8] = {'B', 'U', 'X', 'M', 'Y', 'T', 'R', '1'};
+constexpr uint8_t TAG_NEW_SQL = 0x80;
+constexpr uint64_t MAX_BYTES = 1 << 30;     // Of an SQL text or a parameter, as max_allowed_packet of the server
+constexpr uint64_t MAX_PARAMS = 65535;      // Placeholders of a statement allowed by the server
+
+enum
+{
+    PARAM_NULL      = 1,
+    PARAM_UNSIGNED  = 2
+};
+
+//
+//      In-Module Functions
+//
+void appendVarint(std::string &dst, uint64_t n)
+{
+    for (; n >= 0x80; n >>= 7)
+        dst += static_cast<char>(n | 0x80);
+
+    dst += static_cast<char>(n);
+}
+
+bool readVarint(std::istream &in, uint64_t &n)
+{
+    n = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        const auto c = in.get();
+        if (c == std::char_traits<char>::eof())
+            return false;
+
+        n |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+size_t paramBytes(const MYSQL_BIND &b) noexcept
+{
+    switch (b.buffer_type)
+    {
+    case MYSQL_TYPE_TINY:
+        return 1;
+    case MYSQL_TYPE_SHORT:
+        return 2;
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_FLOAT:
+        return 4;
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_DOUBLE:
+        return 8;
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+        return sizeof(MYSQL_TIME);
+    default:
+        return b.length? *b.length: b.buffer_length;
+    }
+}
+
+uint64_t sinceBase(std::chrono::steady_clock::time_point t, std::chrono::steady_clock::time_point base) noexcept
+{
+    return t > base? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t - base).count()): 0;
+}
+
+} // namespace
+
+namespace bux {
+
+//
+//      Implement Classes
+//
+C_MyTraceRecorder::C_MyTraceRecorder(std::string path):
+    C_MyTraceRecorder(std::move(path), C_Options{})
+{
+}
+
+/*! \param [in] path Trace file to create
+    \param [in] opts Flush interval and buffer limit
+*/
+C_MyTraceRecorder::C_MyTraceRecorder(std::string path, const C_Options &opts):
+    m_path(std::move(path)),
+    m_opts(opts),
+    m_base(std::chrono::steady_clock::now()),
+    m_out(m_path, std::ios::binary|std::ios::trunc)
+{
+    if (!m_out.write(MAGIC, sizeof MAGIC))
+        RUNTIME_ERROR("Fail to create {}", m_path);
+
+    m_writer = std::jthread([this](std::stop_token stop){ writeBuffered(stop); });
+}
+
+C_MyTraceRecorder::~C_MyTraceRecorder()
+{
+    m_writer.request_stop();
+    m_writer.join();
+}
+
+void C_MyTraceRecorder::onOp(const C_MyOpEvent &ev) noexcept
+{
+    if (ev.m_op != MYOP_QUERY && ev.m_op != MYOP_EXEC)
+        return;
+
+    try
+    {
+        const auto start = sinceBase(ev.m_start, m_base);
+        const auto elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(ev.m_elapsed).count());
+        const auto connId = ev.m_mysql? mysql_thread_id(ev.m_mysql): 0;
+        std::string params;
+        appendVarint(params, ev.m_paramCount);
+        for (size_t i = 0; i < ev.m_paramCount; ++i)
+        {
+            const auto &b = ev.m_params[i];
+            const bool isNull = b.buffer_type == MYSQL_TYPE_NULL || b.is_null && *b.is_null || !b.buffer;
+            params += static_cast<char>(b.buffer_type);
+            params += static_cast<char>((isNull? PARAM_NULL: 0) | (b.is_unsigned? PARAM_UNSIGNED: 0));
+            const auto bytes = isNull? 0: paramBytes(b);
+            appendVarint(params, bytes);
+            params.append(static_cast<const char*>(b.buffer), bytes);
+        }
+        std::lock_guard _{m_lock};
+        if (m_buffer.size() >= m_opts.m_maxBuffered)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        const auto found = m_sqlIds.find(ev.m_sql);
+        const bool added = found == m_sqlIds.end();
+        const auto sqlId = added? m_sqlIds.size(): found->second;
+
+        // Built aside so that a failure leaves neither a partial record nor an id never written
+        std::string record(1, static_cast<char>(ev.m_op | (added? TAG_NEW_SQL: 0)));
+        appendVarint(record, start);
+        appendVarint(record, elapsed);
+        appendVarint(record, connId);
+        appendVarint(record, ev.m_errno);
+        appendVarint(record, sqlId);
+        if (added)
+        {
+            appendVarint(record, ev.m_sql.size());
+            record += ev.m_sql;
+        }
+        record += params;
+        const auto oldSize = m_buffer.size();
+        m_buffer += record;
+        if (added)
+            try
+            {
+                m_sqlIds.emplace(ev.m_sql, sqlId);
+            }
+            catch (...)
+            {
+                m_buffer.resize(oldSize);
+                throw;
+            }
+    }
+    catch (...)
+    {
+        // Out of memory: drop the record
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void C_MyTraceRecorder::writeBuffered(std::stop_token stop)
+{
+    std::mutex lock;
+    std::condition_variable_any cv;
+    std::string out;
+    for (bool done = false; !done;)
+    {
+        {
+            std::unique_lock lk{lock};
+            done = cv.wait_for(lk, stop, m_opts.m_flushInterval, []{ return false; }) || stop.stop_requested();
+        }
+        {
+            std::lock_guard _{m_lock};
+            out.swap(m_buffer);
+        }
+        m_out.write(out.data(), static_cast<std::streamsize>(out.size()));
+        m_out.flush();
+        out.clear();
+    }
+}
+
+C_MyTraceReader::C_MyTraceReader(const std::string &path): m_in(path, std::ios::binary)
+{
+    char magic[sizeof MAGIC];
+    if (!m_in.read(magic, sizeof magic) || memcmp(magic, MAGIC, sizeof magic))
+        RUNTIME_ERROR("{} is not a trace file", path);
+}
+
+bool C_MyTraceReader::next(C_MyTraceRecord &rec)
+/*! \return false at the end of file
+    \throw std::runtime_error if the file is corrupt or truncated in the middle of a record
+*/
+{
+    const auto tag = m_in.get();
+    if (tag == std::char_traits<char>::eof())
+        return false;
+
+    uint64_t errNo, len, count;
+    if (!readVarint(m_in, rec.m_startNs) ||
+        !readVarint(m_in, rec.m_elapsedNs) ||
+        !readVarint(m_in, rec.m_connId) ||
+        !readVarint(m_in, errNo) ||
+        !readVarint(m_in, rec.m_sqlId))
+        RUNTIME_ERROR("Truncated record");
+
+    rec.m_op = static_cast<E_MyOp>(tag & ~TAG_NEW_SQL);
+    rec.m_errno = static_cast<unsigned>(errNo);
+    if (tag & TAG_NEW_SQL)
+    {
+        if (rec.m_sqlId != m_sqls.size() || !readVarint(m_in, len))
+            RUNTIME_ERROR("Bad SQL id {}", rec.m_sqlId);
+
+        if (len > MAX_BYTES)
+            RUNTIME_ERROR("Corrupt SQL length {}", len);
+
+        auto &sql = m_sqls.emplace_back(len, '\0');
+        if (!m_in.read(sql.data(), static_cast<std::streamsize>(len)))
+            RUNTIME_ERROR("Truncated SQL");
+    }
+    else if (rec.m_sqlId >= m_sqls.size())
+        RUNTIME_ERROR("Undefined SQL id {}", rec.m_sqlId);
+
+    rec.m_sql = &m_sqls[rec.m_sqlId];
+    if (!readVarint(m_in, count))
+        RUNTIME_ERROR("Truncated record");
+
+    if (count > MAX_PARAMS)
+        RUNTIME_ERROR("Corrupt parameter count {}", count);
+
+    rec.m_params.resize(count);
+    for (auto &i: rec.m_params)
+    {
+        const auto type = m_in.get();
+        const auto flags = m_in.get();
+        if (flags == std::char_traits<char>::eof() || !readVarint(m_in, len))
+            RUNTIME_ERROR("Truncated parameter");
+
+        if (len > MAX_BYTES)
+            RUNTIME_ERROR("Corrupt parameter length {}", len);
+
+        i.m_type = static_cast<enum_field_types>(type);
+        i.m_null = flags & PARAM_NULL;
+        i.m_unsigned = flags & PARAM_UNSIGNED;
+        i.m_bytes.resize(len);
+        if (!m_in.read(i.m_bytes.data(), static_cast<std::streamsize>(len)))
+            RUNTIME_ERROR("Truncated parameter");
+    }
+    return true;
+}
+
+} // namespace bux
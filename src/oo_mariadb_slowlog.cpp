@@ -0,0 +1,331 @@
+﻿#include <bux/oo_mariadb_slowlog.h>
+#include <bux/oo_mariadb_sql.h>     // bux::fingerprintSql(), bux::substituteSqlPlaceholders()
+#include <bux/XException.h> // RUNTIME_ERROR()
+#include <algorithm>        // std::ranges::sort(), std::ranges::replace_if(), std::min()
+#include <bit>              // std::bit_ceil()
+#include <condition_variable>   // std::condition_variable_any
+#include <cstring>          // memcpy()
+#include <filesystem>       // std::filesystem::rename()
+#include <format>           // std::format()
+#include <fstream>          // std::ofstream
+#include <optional>         // std::optional<>
+
+namespace {
+
+//
+//      In-Module Constants
+//
+constexpr size_t MAX_EXPLAIN_JOBS   = 16;
+constexpr size_t MAX_INLINED_BYTES  = 65536;
+
+//
+//      In-Module Data
+//
+thread_local bool t_explaining{};
+
+//
+//      In-Module Functions
+//
+std::optional<std::string> paramLiteral(MYSQL *mysql, const MYSQL_BIND &b)
+/*! \return SQL literal of the bound parameter \a b, or std::nullopt if not supported
+*/
+{
+    if (b.buffer_type == MYSQL_TYPE_NULL || b.is_null && *b.is_null || !b.buffer)
+        return "NULL";
+
+    const auto p = b.buffer;
+    switch (b.buffer_type)
+    {
+    case MYSQL_TYPE_TINY:
+        return b.is_unsigned? std::to_string(*static_cast<const uint8_t*>(p)): std::to_string(*static_cast<const int8_t*>(p));
+    case MYSQL_TYPE_SHORT:
+        return b.is_unsigned? std::to_string(*static_cast<const uint16_t*>(p)): std::to_string(*static_cast<const int16_t*>(p));
+    case MYSQL_TYPE_LONG:
+        return b.is_unsigned? std::to_string(*static_cast<const uint32_t*>(p)): std::to_string(*static_cast<const int32_t*>(p));
+    case MYSQL_TYPE_LONGLONG:
+        return b.is_unsigned? std::to_string(*static_cast<const uint64_t*>(p)): std::to_string(*static_cast<const int64_t*>(p));
+    case MYSQL_TYPE_FLOAT:
+        return std::format("{}", *static_cast<const float*>(p));
+    case MYSQL_TYPE_DOUBLE:
+        return std::format("{}", *static_cast<const double*>(p));
+    case MYSQL_TYPE_DECIMAL:
+    case MYSQL_TYPE_NEWDECIMAL:
+    case MYSQL_TYPE_STRING:
+    case MYSQL_TYPE_VAR_STRING:
+    case MYSQL_TYPE_TINY_BLOB:
+    case MYSQL_TYPE_MEDIUM_BLOB:
+    case MYSQL_TYPE_BLOB:
+    case MYSQL_TYPE_LONG_BLOB:
+        if (const auto bytes = b.length? *b.length: b.buffer_length; bytes <= MAX_INLINED_BYTES)
+            return bux::quotedSql(mysql, {static_cast<const char*>(p), bytes});
+        break;
+    case MYSQL_TYPE_DATE:
+        {
+            const auto &t = *static_cast<const MYSQL_TIME*>(p);
+            return std::format("'{:04}-{:02}-{:02}'", t.year, t.month, t.day);
+        }
+    case MYSQL_TYPE_TIME:
+        {
+            const auto &t = *static_cast<const MYSQL_TIME*>(p);
+            return std::format("'{}{:02}:{:02}:{:02}.{:06}'", t.neg? "-": "", t.hour, t.minute, t.second, t.second_part);
+        }
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+        {
+            const auto &t = *static_cast<const MYSQL_TIME*>(p);
+            return std::format("'{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:06}'",
+                t.year, t.month, t.day, t.hour, t.minute, t.second, t.second_part);
+        }
+    default:;
+    }
+    return {};
+}
+
+} // namespace
+
+namespace bux {
+
+//
+//      Implement Classes
+//
+C_MySlowQueryLog::C_MySlowQueryLog(std::string path):
+    C_MySlowQueryLog(std::move(path), C_Options{})
+{
+}
+
+/*! \param [in] path File to be rewritten with the top N entries every C_Options::m_interval and on destruction
+    \param [in] opts Threshold and table size
+*/
+C_MySlowQueryLog::C_MySlowQueryLog(std::string path, const C_Options &opts):
+    C_MySlowQueryLog(std::move(path), opts, std::nullopt)
+{
+}
+
+/*! \param [in] path File to be rewritten with the top N entries every C_Options::m_interval and on destruction
+    \param [in] opts Threshold, table size and explain rate
+    \param [in] explainConnProto Connection prototype to dup() the side connection for explaining from
+*/
+C_MySlowQueryLog::C_MySlowQueryLog(std::string path, const C_Options &opts, const C_MySQL &explainConnProto):
+    C_MySlowQueryLog(std::move(path), opts, std::optional<C_MySQL>{explainConnProto.dup()})
+{
+}
+
+C_MySlowQueryLog::C_MySlowQueryLog(std::string path, const C_Options &opts, std::optional<C_MySQL> explainConn):
+    m_path(std::move(path)),
+    m_opts(opts),
+    m_mask(std::bit_ceil(std::max<size_t>(opts.m_capacity, MAX_PROBES)) - 1),
+    m_slots(std::make_unique<C_Slot[]>(m_mask + 1)),
+    m_explainConn(std::move(explainConn)),
+    m_explainTokens(opts.m_explainPerMinute),
+    m_explainRefilled(std::chrono::steady_clock::now()),
+    m_dumper([this](std::stop_token stop) {
+        std::mutex lock;
+        std::condition_variable_any cv;
+        std::unique_lock lk{lock};
+        while (!cv.wait_for(lk, stop, m_opts.m_interval, []{ return false; }) && !stop.stop_requested())
+            try
+            {
+                dump();
+            }
+            catch (...)
+            {
+                // Try again next time
+            }
+    })
+{
+    if (m_explainConn)
+        m_explainer = std::jthread([this](std::stop_token stop){ explain(stop); });
+}
+
+C_MySlowQueryLog::~C_MySlowQueryLog()
+{
+    m_dumper.request_stop();
+    m_dumper.join();
+    if (m_explainer.joinable())
+    {
+        m_explainer.request_stop();
+        m_explainer.join();
+    }
+    try
+    {
+        dump();
+    }
+    catch (...)
+    {
+        // Nowhere to report
+    }
+}
+
+void C_MySlowQueryLog::dump() const
+/*! \brief Rewrite the file atomically with the top C_Options::m_topN entries, tab-separated
+*/
+{
+    const auto tmp = m_path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out)
+            RUNTIME_ERROR("Fail to create {}", tmp);
+
+        out <<"total_ms\tcount\tavg_ms\tmax_ms\terrors\tcall_site\tfingerprint\tplan\n";
+        for (auto &i: top(m_opts.m_topN))
+        {
+            // One line per entry
+            std::ranges::replace_if(i.m_plan, [](char c){ return c == '\n' || c == '\r' || c == '\t'; }, ' ');
+            out <<std::format("{:.3f}\t{}\t{:.3f}\t{:.3f}\t{}\t{}\t{}\t{}\n",
+                double(i.m_totalNs) / 1e6, i.m_count, double(i.m_totalNs) / 1e6 / double(i.m_count),
+                double(i.m_maxNs) / 1e6, i.m_errors, i.m_callSite, i.m_fingerprint, i.m_plan);
+        }
+        if (!out.flush())
+            RUNTIME_ERROR("Fail to write {}", tmp);
+    }
+    std::filesystem::rename(tmp, m_path);
+}
+
+void C_MySlowQueryLog::explain(std::stop_token stop)
+{
+    t_explaining = true; // Not to observe myself
+    for (;;)
+    {
+        C_ExplainJob job;
+        {
+            std::unique_lock lk{m_explainLock};
+            if (!m_explainCV.wait(lk, stop, [this]{ return !m_explainJobs.empty(); }))
+                return;
+
+            job = std::move(m_explainJobs.front());
+            m_explainJobs.pop_front();
+        }
+        try
+        {
+            const auto verb = m_opts.m_analyze && !isWriteSql(job.m_sql)? "analyze format=json ": "explain format=json ";
+            auto plan = queryString(*m_explainConn, verb + job.m_sql);
+            std::lock_guard _{m_planLock};
+            m_plans[job.m_hash] = std::move(plan);
+        }
+        catch (...)
+        {
+            // Not explainable, e.g. multiple statements
+        }
+    }
+}
+
+void C_MySlowQueryLog::onOp(const C_MyOpEvent &ev) noexcept
+{
+    if (ev.m_op != MYOP_QUERY && ev.m_op != MYOP_EXEC || ev.m_elapsed < m_opts.m_threshold || t_explaining)
+        return;
+
+    try
+    {
+        const auto fingerprint = fingerprintSql(ev.m_sql);
+        const auto callSite = C_MyCallSite::current();
+        auto hash = std::hash<std::string_view>{}(fingerprint) * 31 + std::hash<std::string_view>{}(callSite);
+        if (!hash)
+            hash = 1;
+
+        for (size_t i = 0; i < MAX_PROBES; ++i)
+        {
+            auto &slot = m_slots[(hash + i) & m_mask];
+            auto cur = slot.m_hash.load(std::memory_order_relaxed);
+            if (!cur && slot.m_hash.compare_exchange_strong(cur, hash, std::memory_order_relaxed))
+            {
+                // Claimed by me
+                slot.m_callSite = callSite;
+                const auto n = std::min<size_t>(fingerprint.size(), FINGERPRINT_MAX);
+                memcpy(slot.m_fingerprint, fingerprint.data(), n);
+                slot.m_fingerprint[n] = 0;
+                slot.m_ready.store(true, std::memory_order_release);
+                cur = hash;
+            }
+            if (cur != hash)
+                continue;
+
+            const auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(ev.m_elapsed).count());
+            slot.m_count.fetch_add(1, std::memory_order_relaxed);
+            slot.m_totalNs.fetch_add(ns, std::memory_order_relaxed);
+            if (ev.m_errno)
+                slot.m_errors.fetch_add(1, std::memory_order_relaxed);
+
+            for (auto old = slot.m_maxNs.load(std::memory_order_relaxed);
+                 old < ns && !slot.m_maxNs.compare_exchange_weak(old, ns, std::memory_order_relaxed););
+            if (m_explainConn)
+                requestExplain(ev, hash);
+
+            return;
+        }
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    catch (...)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void C_MySlowQueryLog::requestExplain(const C_MyOpEvent &ev, uint64_t hash)
+{
+    if (m_slowCount.fetch_add(1, std::memory_order_relaxed) % std::max(m_opts.m_explainEvery, 1U))
+        return;
+
+    std::string sql{ev.m_sql};
+    if (ev.m_paramCount)
+    {
+        std::vector<std::string> literals;
+        for (size_t i = 0; i < ev.m_paramCount; ++i)
+            if (auto lit = paramLiteral(ev.m_mysql, ev.m_params[i]))
+                literals.emplace_back(std::move(*lit));
+            else
+                return;
+
+        sql = substituteSqlPlaceholders(sql, literals);
+    }
+    else if (countSqlPlaceholders(sql))
+        return;
+
+    {
+        std::lock_guard _{m_explainLock};
+        const auto now = std::chrono::steady_clock::now();
+        const double burst = std::max(m_opts.m_explainPerMinute, 1U);
+        m_explainTokens = std::min(m_explainTokens + std::chrono::duration<double>(now - m_explainRefilled).count() *
+            m_opts.m_explainPerMinute / 60, burst);
+        m_explainRefilled = now;
+        if (m_explainTokens < 1 || m_explainJobs.size() >= MAX_EXPLAIN_JOBS)
+            return;
+
+        m_explainTokens -= 1;
+        m_explainJobs.emplace_back(C_ExplainJob{hash, std::move(sql)});
+    }
+    m_explainCV.notify_one();
+}
+
+std::vector<C_MySlowQueryLog::C_Entry> C_MySlowQueryLog::top(size_t n) const
+/*! \return At most \a n entries sorted by total time descending
+*/
+{
+    std::vector<C_Entry> ret;
+    for (size_t i = 0; i <= m_mask; ++i)
+    {
+        auto &slot = m_slots[i];
+        if (!slot.m_ready.load(std::memory_order_acquire))
+            continue;
+
+        const auto count = slot.m_count.load(std::memory_order_relaxed);
+        if (!count)
+            // Claimed but not counted yet
+            continue;
+
+        ret.emplace_back(C_Entry{slot.m_fingerprint, slot.m_callSite, count, slot.m_errors.load(std::memory_order_relaxed),
+            slot.m_totalNs.load(std::memory_order_relaxed), slot.m_maxNs.load(std::memory_order_relaxed), {}});
+        if (m_explainConn)
+        {
+            std::lock_guard _{m_planLock};
+            if (const auto found = m_plans.find(slot.m_hash.load(std::memory_order_relaxed)); found != m_plans.end())
+                ret.back().m_plan = found->second;
+        }
+    }
+    std::ranges::sort(ret, [](auto &a, auto &b){ return a.m_totalNs > b.m_totalNs; });
+    if (ret.size() > n)
+        ret.resize(n);
+
+    return ret;
+}
+
+} // namespace bux
@@ -0,0 +1,473 @@
+﻿#include <bux/oo_mariadb_sql.h>
+#include <algorithm>        // std::find()
+#include <cctype>           // isalnum(), isdigit(), isspace(), tolower()
+
+namespace {
+
+//
+//      In-Module Types
+//
+enum E_SqlToken
+{
+    TK_END,
+    TK_WORD,        // keyword or bare identifier
+    TK_QUOTED_ID,   // `identifier`
+    TK_STRING,      // 'literal' or "literal"
+    TK_NUMBER,
+    TK_PLACEHOLDER, // ?
+    TK_PUNCT        // any other single char
+};
+
+struct C_SqlToken
+{
+    E_SqlToken          m_kind;
+    std::string_view    m_text;
+    bool                m_spaced;   // preceded by whitespace or comments
+};
+
+class C_SqlLexer
+/// \brief Just enough of MariaDB lexical rules to tell literals, identifiers and comments apart
+{
+public:
+
+    // Nonvirtuals
+    C_SqlLexer(std::string_view sql): m_src(sql) {}
+    C_SqlToken next();
+
+private:
+
+    // Data
+    std::string_view    m_src;
+    size_t              m_pos{};
+
+    // Nonvirtuals
+    bool skipBlank();
+    void skipQuoted(char quote);
+};
+
+//
+//      In-Module Functions
+//
+bool isIdChar(char c)
+{
+    return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' || static_cast<unsigned char>(c) >= 0x80;
+}
+
+bool iequal(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); ++i)
+        if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i])))
+            return false;
+
+    return true;
+}
+
+template<size_t N>
+bool isOneOf(std::string_view word, const char *const (&list)[N])
+{
+    for (auto i: list)
+        if (iequal(word, i))
+            return true;
+
+    return false;
+}
+
+template<size_t N>
+bool anyStatementStartsWith(std::string_view sql, const char *const (&verbs)[N])
+{
+    bool stmtStart = true;
+    C_SqlLexer lex(sql);
+    for (C_SqlToken t; t = lex.next(), t.m_kind != TK_END;)
+    {
+        if (t.m_kind == TK_PUNCT && t.m_text == ";")
+            stmtStart = true;
+        else if (stmtStart)
+        {
+            if (t.m_kind == TK_WORD && isOneOf(t.m_text, verbs))
+                return true;
+
+            stmtStart = t.m_kind == TK_PUNCT && t.m_text == "(";
+        }
+    }
+    return false;
+}
+
+std::string lowerId(const C_SqlToken &t)
+{
+    auto s = t.m_text;
+    if (t.m_kind == TK_QUOTED_ID)
+        s = s.substr(1, s.size() - 2);
+
+    std::string ret;
+    ret.reserve(s.size());
+    for (char c: s)
+        ret += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return ret;
+}
+
+bool isName(const C_SqlToken &t)
+{
+    return t.m_kind == TK_WORD || t.m_kind == TK_QUOTED_ID;
+}
+
+//
+//      Implement Classes
+//
+C_SqlToken C_SqlLexer::next()
+{
+    const bool spaced = skipBlank();
+    const auto start = m_pos;
+    if (m_pos >= m_src.size())
+        return {TK_END, {}, spaced};
+
+    E_SqlToken kind;
+    const char c = m_src[m_pos];
+    if (c == '\'' || c == '"')
+    {
+        skipQuoted(c);
+        kind = TK_STRING;
+    }
+    else if (c == '`')
+    {
+        skipQuoted(c);
+        kind = TK_QUOTED_ID;
+    }
+    else if (isdigit(static_cast<unsigned char>(c)) ||
+             c == '.' && m_pos + 1 < m_src.size() && isdigit(static_cast<unsigned char>(m_src[m_pos+1])))
+    {
+        while (++m_pos < m_src.size())
+        {
+            const char d = m_src[m_pos];
+            if (d == '.' || isIdChar(d))
+                continue;
+            if ((d == '+' || d == '-') && (m_src[m_pos-1] == 'e' || m_src[m_pos-1] == 'E'))
+                continue;
+            break;
+        }
+        kind = TK_NUMBER;
+    }
+    else if (isIdChar(c))
+    {
+        while (++m_pos < m_src.size() && isIdChar(m_src[m_pos]));
+        kind = TK_WORD;
+    }
+    else
+    {
+        ++m_pos;
+        kind = c == '?'? TK_PLACEHOLDER: TK_PUNCT;
+    }
+    return {kind, m_src.substr(start, m_pos - start), spaced};
+}
+
+bool C_SqlLexer::skipBlank()
+{
+    bool ret = false;
+    while (m_pos < m_src.size())
+    {
+        const auto rest = m_src.substr(m_pos);
+        if (isspace(static_cast<unsigned char>(rest[0])))
+            ++m_pos;
+        else if (rest[0] == '#' || rest.starts_with("--") && (rest.size() == 2 || isspace(static_cast<unsigned char>(rest[2]))))
+        {
+            const auto eol = rest.find('\n');
+            m_pos = eol == rest.npos? m_src.size(): m_pos + eol + 1;
+        }
+        else if (rest.starts_with("/*!") || rest.starts_with("/*M!"))
+        {
+            // Executable comment: the content counts as SQL
+            m_pos += rest[2] == '!'? 3: 4;
+            while (m_pos < m_src.size() && isdigit(static_cast<unsigned char>(m_src[m_pos])))
+                ++m_pos;
+        }
+        else if (rest.starts_with("/*"))
+        {
+            const auto end = rest.find("*/", 2);
+            m_pos = end == rest.npos? m_src.size(): m_pos + end + 2;
+        }
+        else if (rest.starts_with("*/"))
+            // Closing an executable comment
+            m_pos += 2;
+        else
+            break;
+
+        ret = true;
+    }
+    return ret;
+}
+
+void C_SqlLexer::skipQuoted(char quote)
+{
+    while (++m_pos < m_src.size())
+    {
+        const char c = m_src[m_pos];
+        if (c == '\\' && quote != '`')
+            ++m_pos;
+        else if (c == quote)
+        {
+            if (m_pos + 1 < m_src.size() && m_src[m_pos+1] == quote)
+                ++m_pos; // Doubled quote
+            else
+            {
+                ++m_pos;
+                return;
+            }
+        }
+    }
+    m_pos = m_src.size(); // Unterminated
+}
+
+} // namespace
+
+namespace bux {
+
+//
+//      Functions
+//
+size_t countSqlPlaceholders(std::string_view sql)
+{
+    size_t ret = 0;
+    C_SqlLexer lex(sql);
+    for (C_SqlToken t; t = lex.next(), t.m_kind != TK_END;)
+        if (t.m_kind == TK_PLACEHOLDER)
+            ++ret;
+
+    return ret;
+}
+
+bool isCallSql(std::string_view sql)
+/*! \return true if any of the (possibly multiple) statements calls a stored procedure, whose tables are unknown
+*/
+{
+    static const char *const CALL_VERBS[] = {"call"};
+    return anyStatementStartsWith(sql, CALL_VERBS);
+}
+
+bool isCommitSql(std::string_view sql)
+/*! \return true if any of the (possibly multiple) statements is an explicit COMMIT
+*/
+{
+    static const char *const COMMIT_VERBS[] = {"commit"};
+    return anyStatementStartsWith(sql, COMMIT_VERBS);
+}
+
+bool isWriteSql(std::string_view sql)
+/*! \return true if any of the (possibly multiple) statements may modify data or schema
+*/
+{
+    static const char *const WRITE_VERBS[] = {
+        "alter", "call", "create", "delete", "drop", "insert", "load", "rename", "replace", "truncate", "update"
+    };
+    return anyStatementStartsWith(sql, WRITE_VERBS);
+}
+
+std::string fingerprintSql(std::string_view sql)
+/*! \brief Reduce \a sql to what identifies its kind for aggregation: literals and placeholders become '?',
+    lists of them collapse into "?+", repeated row tuples collapse into one, and names are lowercased.
+*/
+{
+    std::string ret;
+    ret.reserve(sql.size());
+    std::vector<size_t> opens;
+    bool prevPunct = false;
+    C_SqlLexer lex(sql);
+    for (C_SqlToken t; t = lex.next(), t.m_kind != TK_END;)
+    {
+        std::string text;
+        switch (t.m_kind)
+        {
+        case TK_STRING:
+        case TK_NUMBER:
+        case TK_PLACEHOLDER:
+            text = "?";
+            break;
+        case TK_WORD:
+        case TK_QUOTED_ID:
+            text = lowerId(t);
+            break;
+        default:
+            text = t.m_text;
+        }
+        // One space between tokens regardless of the original spacing, except around "(),.;" and within operators
+        const bool punct = t.m_kind == TK_PUNCT;
+        if (!ret.empty() && ret.back() != '(' && ret.back() != ',' && ret.back() != '.' &&
+            text != "(" && text != ")" && text != "," && text != "." && text != ";" && !(punct && prevPunct))
+            ret += ' ';
+
+        prevPunct = punct && text != ")";
+
+        if (text == "?" && ret.ends_with("?,"))
+        {
+            // ?,? => ?+
+            ret.pop_back();
+            ret += '+';
+        }
+        else if (text == "?" && ret.ends_with("?+,"))
+            ret.pop_back();
+        else
+        {
+            ret += text;
+            if (text == "(")
+                opens.emplace_back(ret.size() - 1);
+            else if (text == ")" && !opens.empty())
+            {
+                // (...),(...) => (...)
+                const auto open = opens.back();
+                opens.pop_back();
+                const std::string_view tuple = std::string_view{ret}.substr(open);
+                if (open > tuple.size() && std::string_view{ret}.substr(0, open - 1).ends_with(tuple) && ret[open-1] == ',')
+                    ret.resize(open - 1);
+            }
+        }
+    }
+    while (!ret.empty() && (ret.back() == ';' || ret.back() == ' '))
+        ret.pop_back();
+
+    return ret;
+}
+
+std::string normalizeSql(std::string_view sql)
+/*! \brief Collapse whitespace & comments into single spaces and drop trailing semicolons.
+    Letter cases are kept because table names can be case-sensitive.
+*/
+{
+    std::string ret;
+    ret.reserve(sql.size());
+    C_SqlLexer lex(sql);
+    for (C_SqlToken t; t = lex.next(), t.m_kind != TK_END;)
+    {
+        if (t.m_spaced && !ret.empty())
+            ret += ' ';
+
+        ret += t.m_text;
+    }
+    while (!ret.empty() && (ret.back() == ';' || ret.back() == ' '))
+        ret.pop_back();
+
+    return ret;
+}
+
+std::string substituteSqlPlaceholders(std::string_view sql, const std::vector<std::string> &literals)
+/*! \brief Replace the i-th placeholder '?' of \a sql with \a literals[i], which must have been escaped and quoted.
+    Placeholders in excess of \a literals are left intact.
+*/
+{
+    std::string ret;
+    ret.reserve(sql.size());
+    size_t copied = 0, ind = 0;
+    C_SqlLexer lex(sql);
+    for (C_SqlToken t; t = lex.next(), t.m_kind != TK_END && ind < literals.size();)
+        if (t.m_kind == TK_PLACEHOLDER)
+        {
+            const auto pos = static_cast<size_t>(t.m_text.data() - sql.data());
+            ret.append(sql.substr(copied, pos - copied)).append(literals[ind++]);
+            copied = pos + 1;
+        }
+
+    ret.append(sql.substr(copied));
+    return ret;
+}
+
+std::vector<std::string> sqlTables(std::string_view sql)
+/*! \return Lowercased unqualified names of the tables referenced by \a sql, without duplicates.
+    Errs on the side of listing too many, which is harmless for cache invalidation.
+*/
+{
+    static const char *const TABLE_LEADERS[] = {
+        "from", "into", "join", "straight_join", "table", "tables", "update"
+    };
+    static const char *const INSERT_VERBS[] = {
+        "insert", "replace"
+    };
+    static const char *const INSERT_MODIFIERS[] = {
+        "delayed", "high_priority", "ignore", "into", "low_priority"
+    };
+    static const char *const NOT_ALIASES[] = {
+        "as", "cross", "except", "for", "force", "group", "having", "ignore", "inner", "intersect",
+        "into", "join", "left", "limit", "lock", "natural", "on", "order", "outer", "partition",
+        "procedure", "read", "returning", "right", "select", "set", "straight_join", "union", "use",
+        "using", "value", "values", "where", "window", "with", "write"
+    };
+    static const char *const LOCK_TYPES[] = {
+        "local", "low_priority", "read", "write"
+    };
+    enum
+    {
+        EXPECT_NONE,
+        EXPECT_TABLE,   // right after a table leader
+        EXPECT_ALIAS,   // right after a table name
+        EXPECT_LIST     // right after an alias or a lock type, where ',' starts another table
+    } state = EXPECT_NONE;
+
+    std::vector<std::string> ret;
+    const auto add = [&](const C_SqlToken &t) {
+        auto name = lowerId(t);
+        if (std::find(ret.begin(), ret.end(), name) == ret.end())
+            ret.emplace_back(std::move(name));
+    };
+    C_SqlLexer lex(sql);
+    C_SqlToken t = lex.next();
+    while (t.m_kind != TK_END)
+    {
+        if (state == EXPECT_TABLE && isName(t) && !(t.m_kind == TK_WORD && isOneOf(t.m_text, INSERT_MODIFIERS)))
+        {
+            // [db.]table
+            C_SqlToken name = t;
+            for (t = lex.next(); t.m_kind == TK_PUNCT && t.m_text == "."; t = lex.next())
+            {
+                const auto part = lex.next();
+                if (!isName(part))
+                    break;
+
+                name = part;
+            }
+            add(name);
+            state = EXPECT_ALIAS;
+            continue;
+        }
+        if (state == EXPECT_ALIAS || state == EXPECT_LIST)
+        {
+            if (t.m_kind == TK_PUNCT && t.m_text == ",")
+            {
+                state = EXPECT_TABLE;
+                t = lex.next();
+                continue;
+            }
+            if (state == EXPECT_ALIAS)
+            {
+                if (t.m_kind == TK_WORD && iequal(t.m_text, "as"))
+                {
+                    t = lex.next();
+                    continue;
+                }
+                if (t.m_kind == TK_QUOTED_ID || t.m_kind == TK_WORD && !isOneOf(t.m_text, NOT_ALIASES))
+                {
+                    state = EXPECT_LIST;
+                    t = lex.next();
+                    continue;
+                }
+            }
+            if (t.m_kind == TK_WORD && isOneOf(t.m_text, LOCK_TYPES))
+                // lock tables t read, u write
+            {
+                state = EXPECT_LIST;
+                t = lex.next();
+                continue;
+            }
+        }
+        state = EXPECT_NONE;
+        if (t.m_kind == TK_WORD)
+        {
+            if (isOneOf(t.m_text, TABLE_LEADERS))
+                state = EXPECT_TABLE;
+            else if (isOneOf(t.m_text, INSERT_VERBS))
+                state = EXPECT_TABLE; // "insert t values ..." without "into"
+        }
+        t = lex.next();
+    }
+    return ret;
+}
+
+} // namespace bux
@@ -0,0 +1,263 @@
+﻿#include <bux/oo_mariadb_trace.h>
+#include <bux/XException.h> // RUNTIME_ERROR()
+#include <algorithm>        // std::max()
+#include <bit>              // std::bit_ceil()
+#include <condition_variable>   // std::condition_variable_any
+#include <cstring>          // memcpy()
+#include <format>           // std::format()
+#include <mutex>            // std::mutex
+#include <random>           // std::random_device
+
+namespace {
+
+//
+//      In-Module Data
+//
+std::atomic<uint64_t>       g_nextId{(uint64_t(std::random_device{}()) << 32 | std::random_device{}()) | 1};
+std::atomic<uint64_t>       g_nextThreadId{1};
+thread_local bux::C_MySpanContext t_span{};
+
+//
+//      In-Module Functions
+//
+uint64_t newId() noexcept
+{
+    return g_nextId.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t threadId() noexcept
+/*! \return Small number for Chrome trace viewer to lay out a row per thread
+*/
+{
+    thread_local const uint64_t id = g_nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+int64_t sinceEpoch(std::chrono::steady_clock::time_point t) noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+const char *opName(bux::E_MyOp op) noexcept
+{
+    switch (op)
+    {
+    case bux::MYOP_CONNECT:
+        return "connect";
+    case bux::MYOP_QUERY:
+        return "query";
+    case bux::MYOP_STORE:
+        return "store";
+    case bux::MYOP_PREPARE:
+        return "prepare";
+    case bux::MYOP_BIND:
+        return "bind";
+    case bux::MYOP_EXEC:
+        return "exec";
+    case bux::MYOP_FETCH:
+        return "fetch";
+    default:
+        return "?";
+    }
+}
+
+std::string jsonEscaped(std::string_view s)
+{
+    std::string ret;
+    ret.reserve(s.size());
+    for (char c: s)
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            ret.append(1, '\\') += c;
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+                ret += std::format("\\u{:04x}", c);
+            else
+                ret += c;
+        }
+    return ret;
+}
+
+size_t utf8Prefix(std::string_view s, size_t max) noexcept
+/*! \return Length of the longest prefix of \a s within \a max bytes not cutting a UTF-8 sequence
+*/
+{
+    if (s.size() <= max)
+        return s.size();
+
+    while (max && (static_cast<unsigned char>(s[max]) & 0xC0) == 0x80)
+        // s[max] continues the sequence being cut
+        --max;
+
+    return max;
+}
+
+} // namespace
+
+namespace bux {
+
+//
+//      Implement Classes
+//
+C_MyTracer::C_MyTracer(std::string path):
+    C_MyTracer(std::move(path), C_Options{})
+{
+}
+
+/*! \param [in] path Trace file to create, in JSON array format
+    \param [in] opts Ring size and flush interval
+*/
+C_MyTracer::C_MyTracer(std::string path, const C_Options &opts):
+    m_path(std::move(path)),
+    m_opts(opts),
+    m_mask(std::bit_ceil(std::max<size_t>(opts.m_ringSize, 2)) - 1),
+    m_cells(std::make_unique<C_Cell[]>(m_mask + 1)),
+    m_out(m_path, std::ios::trunc)
+{
+    if (!m_out)
+        RUNTIME_ERROR("Fail to create {}", m_path);
+
+    for (size_t i = 0; i <= m_mask; ++i)
+        m_cells[i].m_seq.store(i, std::memory_order_relaxed);
+
+    m_out <<"[\n";
+    m_exporter = std::jthread([this](std::stop_token stop){ exportSpans(stop); });
+}
+
+C_MyTracer::~C_MyTracer()
+{
+    m_exporter.request_stop();
+    m_exporter.join();
+}
+
+void C_MyTracer::exportSpans(std::stop_token stop)
+{
+    std::mutex lock;
+    std::condition_variable_any cv;
+    bool first = true;
+    for (bool done = false; !done;)
+    {
+        {
+            std::unique_lock lk{lock};
+            done = cv.wait_for(lk, stop, m_opts.m_flushInterval, []{ return false; }) || stop.stop_requested();
+        }
+        for (C_Span span; pop(span);)
+        {
+            const auto sql = jsonEscaped({span.m_sql, strnlen(span.m_sql, sizeof span.m_sql)});
+            m_out <<(first? "": ",\n") <<std::format(
+                R"({{"name":"{}","cat":"mysql","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":1,"tid":{},)"
+                R"("args":{{"trace":"{:016x}","span":"{:016x}","parent":"{:016x}","rows":{},"errno":{},"sql":"{}"}}}})",
+                span.m_name, double(span.m_startNs) / 1e3, double(span.m_durationNs) / 1e3, span.m_threadId,
+                span.m_context.m_traceId, span.m_context.m_spanId, span.m_parentId, span.m_rows, span.m_errno, sql);
+            first = false;
+        }
+        m_out.flush();
+    }
+    m_out <<"\n]\n";
+}
+
+void C_MyTracer::onOp(const C_MyOpEvent &ev) noexcept
+{
+    const auto parent = C_MyTraceScope::current();
+    C_Span span{{parent.m_traceId? parent.m_traceId: newId(), newId()}, parent.m_spanId, opName(ev.m_op),
+        sinceEpoch(ev.m_start), std::chrono::duration_cast<std::chrono::nanoseconds>(ev.m_elapsed).count(),
+        threadId(), ev.m_rows, ev.m_errno, {}};
+    const auto n = utf8Prefix(ev.m_sql, sizeof span.m_sql - 1);
+    memcpy(span.m_sql, ev.m_sql.data(), n);
+    record(span);
+}
+
+bool C_MyTracer::pop(C_Span &span) noexcept
+{
+    auto pos = m_dequeuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        auto &cell = m_cells[pos & m_mask];
+        const auto seq = cell.m_seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (!diff)
+        {
+            if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                span = cell.m_span;
+                cell.m_seq.store(pos + m_mask + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+            // Empty
+            return false;
+        else
+            pos = m_dequeuePos.load(std::memory_order_relaxed);
+    }
+}
+
+void C_MyTracer::record(const C_Span &span) noexcept
+/*! \brief Enqueue \a span for export, or drop it if the ring is full
+*/
+{
+    auto pos = m_enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        auto &cell = m_cells[pos & m_mask];
+        const auto seq = cell.m_seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (!diff)
+        {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell.m_span = span;
+                cell.m_seq.store(pos + 1, std::memory_order_release);
+                return;
+            }
+        }
+        else if (diff < 0)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+    }
+}
+
+C_MyTraceScope::C_MyTraceScope(C_MyTracer &tracer, const char *name) noexcept:
+    C_MyTraceScope(tracer, name, t_span)
+{
+}
+
+/*! \param [in] tracer Where to record the span on destruction
+    \param [in] name Static string to name the span
+    \param [in] parent Context of the parent span, e.g. C_MyTraceScope::current() of another thread
+*/
+C_MyTraceScope::C_MyTraceScope(C_MyTracer &tracer, const char *name, const C_MySpanContext &parent) noexcept:
+    m_tracer(tracer),
+    m_name(name),
+    m_outer(t_span),
+    m_context{parent.m_traceId? parent.m_traceId: newId(), newId()},
+    m_parentId(parent.m_spanId),
+    m_start(std::chrono::steady_clock::now())
+{
+    t_span = m_context;
+}
+
+C_MyTraceScope::~C_MyTraceScope()
+{
+    t_span = m_outer;
+    C_MyTracer::C_Span span{m_context, m_parentId, m_name, sinceEpoch(m_start),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count(),
+        threadId(), 0, 0, {}};
+    m_tracer.record(span);
+}
+
+C_MySpanContext C_MyTraceScope::current() noexcept
+/*! \return Context of the innermost C_MyTraceScope alive in the current thread, or zeros if none
+*/
+{
+    return t_span;
+}
+
+} // namespace bux
@@ -0,0 +1,204 @@
+﻿#include <bux/oo_mariadb_writebehind.h>
+#include <algorithm>        // std::max()
+#include <condition_variable>   // std::condition_variable_any
+#include <format>           // std::format()
+
+namespace bux {
+
+//
+//      Implement Classes
+//
+C_MyWriteBehind::C_MyWriteBehind(const C_MySQL &connProto, std::string table, std::string keyColumn, std::string countColumn):
+    C_MyWriteBehind(connProto, std::move(table), std::move(keyColumn), std::move(countColumn), C_Options{})
+{
+}
+
+/*! \param [in] connProto Connection prototype to dup() from
+    \param [in] table Table whose \a keyColumn is its primary or unique key
+    \param [in] keyColumn Column to match keys passed to add()
+    \param [in] countColumn Counter column to which deltas are added
+    \param [in] opts Flush interval and memory bounds
+*/
+C_MyWriteBehind::C_MyWriteBehind(const C_MySQL &connProto, std::string table, std::string keyColumn, std::string countColumn,
+    const C_Options &opts):
+    m_mysql(connProto.dup()),
+    m_table(std::move(table)),
+    m_keyColumn(std::move(keyColumn)),
+    m_countColumn(std::move(countColumn)),
+    m_opts{opts.m_interval, std::max<size_t>(opts.m_shards, 1), std::max<size_t>(opts.m_maxKeys, 1),
+        std::max<size_t>(opts.m_rowsPerStmt, 1), opts.m_overflow},
+    m_shards(std::make_unique<C_Shard[]>(m_opts.m_shards)),
+    m_flusher([this](std::stop_token stop) {
+        std::mutex lock;
+        std::condition_variable_any cv;
+        std::unique_lock lk{lock};
+        while (!cv.wait_for(lk, stop, m_opts.m_interval, []{ return false; }) && !stop.stop_requested())
+            try
+            {
+                flush();
+            }
+            catch (const std::exception &e)
+            {
+                setError(e.what());
+            }
+    })
+{
+}
+
+C_MyWriteBehind::~C_MyWriteBehind()
+{
+    m_flusher.request_stop();
+    m_flusher.join();
+    try
+    {
+        flush();
+    }
+    catch (const std::exception &e)
+    {
+        setError(e.what());
+    }
+}
+
+void C_MyWriteBehind::add(std::string_view key, long long delta)
+/*! \brief Add \a delta to the pending delta of \a key, never throwing on database errors
+*/
+{
+    auto &shard = m_shards[std::hash<std::string_view>{}(key) % m_opts.m_shards];
+    if (tryAdd(shard, key, delta))
+        return;
+
+    // Make room in the calling thread
+    flushNoThrow(shard);
+    if (tryAdd(shard, key, delta))
+        return;
+
+    if (m_opts.m_overflow == OVERFLOW_DROP)
+    {
+        m_droppedDeltas.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    do
+    {
+        std::unique_lock lk{m_roomLock};
+        m_room.wait_for(lk, m_opts.m_interval, [this]{ return m_pendingKeys.load() < m_opts.m_maxKeys; });
+    } while (!tryAdd(shard, key, delta));
+}
+
+void C_MyWriteBehind::flush()
+{
+    for (size_t i = 0; i < m_opts.m_shards; ++i)
+        flush(m_shards[i]);
+}
+
+void C_MyWriteBehind::flush(C_Shard &shard)
+{
+    std::unordered_map<std::string,long long> deltas;
+    {
+        std::lock_guard _{shard.m_lock};
+        deltas.swap(shard.m_deltas);
+    }
+    if (deltas.empty())
+        return;
+
+    const auto written = [&](size_t keys) {
+        m_pendingKeys.fetch_sub(keys, std::memory_order_relaxed);
+        std::lock_guard _{m_roomLock};
+        m_room.notify_all();
+    };
+    try
+    {
+        std::lock_guard _{m_connLock};
+        MYSQL *const mysql = m_mysql;
+        const auto head = std::format("insert into {} ({},{}) values ", m_table, m_keyColumn, m_countColumn);
+        const auto tail = std::format(" on duplicate key update {0}={0}+values({0})", m_countColumn);
+        if (const auto zeros = std::erase_if(deltas, [](auto &i){ return !i.second; }))
+            written(zeros);
+
+        while (!deltas.empty())
+        {
+            auto sql = head;
+            auto end = deltas.begin();
+            size_t rows = 0;
+            for (; end != deltas.end() && rows < m_opts.m_rowsPerStmt; ++end, ++rows)
+            {
+                if (rows)
+                    sql += ',';
+
+                sql.append(1, '(').append(quotedSql(mysql, end->first)).append(1, ',').append(std::to_string(end->second)) += ')';
+            }
+            query(mysql, sql + tail);
+            m_flushedRows.fetch_add(rows, std::memory_order_relaxed);
+            deltas.erase(deltas.begin(), end);
+            written(rows);
+        }
+    }
+    catch (...)
+    {
+        // Merge back what have not been written, still counted as pending
+        size_t merged = 0;
+        {
+            std::lock_guard _{shard.m_lock};
+            for (auto &i: deltas)
+                if (const auto [it, added] = shard.m_deltas.try_emplace(i.first, i.second); !added)
+                {
+                    it->second += i.second;
+                    ++merged;
+                }
+        }
+        if (merged)
+            written(merged);
+        throw;
+    }
+}
+
+std::string C_MyWriteBehind::lastError() const
+{
+    std::lock_guard _{m_errorLock};
+    return m_lastError;
+}
+
+void C_MyWriteBehind::flushNoThrow(C_Shard &shard) noexcept
+{
+    try
+    {
+        flush(shard);
+    }
+    catch (const std::exception &e)
+    {
+        setError(e.what());
+    }
+}
+
+void C_MyWriteBehind::setError(std::string_view error) noexcept
+{
+    try
+    {
+        std::lock_guard _{m_errorLock};
+        m_lastError = error;
+    }
+    catch (...)
+    {
+        // Out of memory: keep the previous error
+    }
+}
+
+bool C_MyWriteBehind::tryAdd(C_Shard &shard, std::string_view key, long long delta)
+/*! \return false if \a key is new to \a shard but m_opts.m_maxKeys keys are already pending
+*/
+{
+    std::string k{key};
+    std::lock_guard _{shard.m_lock};
+    if (auto found = shard.m_deltas.find(k); found != shard.m_deltas.end())
+    {
+        found->second += delta;
+        return true;
+    }
+    if (m_pendingKeys.load(std::memory_order_relaxed) >= m_opts.m_maxKeys)
+        return false;
+
+    shard.m_deltas.emplace(std::move(k), delta);
+    m_pendingKeys.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace bux
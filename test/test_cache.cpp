@@ -0,0 +1,86 @@
+﻿#include "fake_connector.h"
+#include <bux/oo_mariadb.h> // bux::bindInt(), bux::C_MySQL
+#include <bux/oo_mariadb_cache.h>   // bux::cacheKey(), bux::C_MyQueryCache, bux::invalidateAllCaches()
+#include <gtest/gtest.h>    // TEST(), EXPECT_EQ()
+#include <cstring>          // memset()
+
+namespace {
+
+//
+//      In-Module Functions
+//
+MYSQL_BIND intParam(int &value)
+{
+    MYSQL_BIND ret;
+    memset(&ret, 0, sizeof ret);
+    bux::bindInt(ret, value);
+    return ret;
+}
+
+size_t g_selects{};
+
+const bux::C_FakeReply &countSelects(std::string_view sql)
+{
+    static const bux::C_FakeReply rows{.m_fields = {"a"}, .m_rows = {{"1"}}}, none;
+    if (!sql.starts_with("select a"))
+        return none;
+
+    ++g_selects;
+    return rows;
+}
+
+} // namespace
+
+TEST(CacheKey, NormalizedSql)
+{
+    EXPECT_EQ(bux::cacheKey("db", "select  a from t", nullptr, 0), bux::cacheKey("db", "select a\nfrom t", nullptr, 0));
+    EXPECT_NE(bux::cacheKey("db", "select a from t", nullptr, 0), bux::cacheKey("db", "select b from t", nullptr, 0));
+}
+
+TEST(CacheKey, DefaultDatabase)
+{
+    EXPECT_NE(bux::cacheKey("db1", "select a from t", nullptr, 0), bux::cacheKey("db2", "select a from t", nullptr, 0));
+    EXPECT_NE(bux::cacheKey("", "select a from t", nullptr, 0), bux::cacheKey("db", "select a from t", nullptr, 0));
+}
+
+TEST(CacheKey, BoundParams)
+{
+    int one = 1, two = 2, again = 1;
+    const auto b1 = intParam(one), b2 = intParam(two), b3 = intParam(again);
+    EXPECT_NE(bux::cacheKey("db", "select a from t where id=?", &b1, 1), bux::cacheKey("db", "select a from t where id=?", &b2, 1));
+    EXPECT_EQ(bux::cacheKey("db", "select a from t where id=?", &b1, 1), bux::cacheKey("db", "select a from t where id=?", &b3, 1));
+}
+
+TEST(QueryCache, InvalidateAll)
+{
+    bux::setFakeReplier(countSelects);
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MyQueryCache cache;
+    g_selects = 0;
+    cache.query(mysql, "select a from t");
+    cache.query(mysql, "select a from t");
+    EXPECT_EQ(g_selects, 1u);
+
+    bux::invalidateAllCaches();
+    EXPECT_EQ(cache.stats().m_entries, 0u);
+    cache.query(mysql, "select a from t");
+    EXPECT_EQ(g_selects, 2u);
+}
+
+TEST(QueryCache, BypassedInTransaction)
+{
+    bux::setFakeReplier(countSelects);
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MyQueryCache cache;
+    g_selects = 0;
+    bux::query(mysql, "BEGIN");
+    cache.query(mysql, "select a from t");
+    cache.query(mysql, "select a from t");
+    EXPECT_EQ(g_selects, 2u);
+    EXPECT_EQ(cache.stats().m_entries, 0u);
+
+    bux::query(mysql, "COMMIT");
+    cache.query(mysql, "select a from t");
+    cache.query(mysql, "select a from t");
+    EXPECT_EQ(g_selects, 3u);
+}
@@ -0,0 +1,165 @@
+﻿#include "fake_connector.h"
+#include <bux/oo_mariadb.h> // bux::C_LockTablesTillEnd, bux::C_MySQL
+#include <gtest/gtest.h>    // TEST(), EXPECT_EQ()
+#include <string>           // std::string
+#include <vector>           // std::vector<>
+
+TEST(MySQL, MoveTakesOverConnectionAndCounters)
+{
+    bux::setFakeReply({});
+    bux::C_MySQL src{bux::C_MyConnectArg{}};
+    const auto conn = src.mysql();
+    const auto roundTrips = src.roundTrips();
+    EXPECT_GT(roundTrips, 0u);
+
+    bux::C_MySQL dst{std::move(src)};
+    EXPECT_EQ(dst.roundTrips(), roundTrips);
+    EXPECT_EQ(src.roundTrips(), 0u);
+    EXPECT_EQ(dst.mysql(), conn);
+    EXPECT_EQ(dst.roundTrips(), roundTrips + 1);    // Ping by mysql() counted through the connection user data
+
+    // Moved-from instance reconnects with the shared connection argument
+    EXPECT_NE(src.mysql(), nullptr);
+    EXPECT_NE(src.threadId(), dst.threadId());
+}
+
+TEST(MySQL, HeldInVector)
+{
+    bux::setFakeReply({});
+    std::vector<bux::C_MySQL> pool;
+    for (int i = 0; i < 8; ++i)
+        pool.emplace_back(bux::C_MyConnectArg{}).mysql();  // Reallocations move connections
+
+    for (auto &i: pool)
+        EXPECT_NE(i.mysql(), nullptr);
+
+    EXPECT_NE(pool.front().dup().threadId(), pool.front().threadId());
+}
+
+TEST(MySQL, ErrorKinds)
+{
+    EXPECT_EQ(bux::errorKind(1205), bux::MYERR_RETRYABLE);
+    EXPECT_EQ(bux::errorKind(1213), bux::MYERR_RETRYABLE);
+    EXPECT_EQ(bux::errorKind(2006), bux::MYERR_CONNECTION);
+    EXPECT_EQ(bux::errorKind(2013), bux::MYERR_CONNECTION);
+    EXPECT_EQ(bux::errorKind(1062), bux::MYERR_DUPLICATE);
+    EXPECT_EQ(bux::errorKind(1064), bux::MYERR_FATAL);
+}
+
+TEST(MySQL, TryQueryReturnsRows)
+{
+    bux::setFakeReply({.m_fields = {"k", "v"}, .m_rows = {{"1", std::nullopt}, {"2", "two"}}});
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    const auto conn = mysql.tryMysql();
+    ASSERT_TRUE(conn);
+
+    const auto rows = bux::tryQueryRows(*conn, "select k,v from t");
+    ASSERT_TRUE(rows);
+    ASSERT_EQ(rows->m_rows.size(), 2u);
+    EXPECT_FALSE(rows->m_rows[0][1]);
+    EXPECT_EQ(*rows->m_rows[1][1], "two");
+
+    const auto str = bux::tryQueryString(*conn, "select k,v from t", 1);
+    ASSERT_TRUE(str);
+    EXPECT_EQ(*str, "two");
+
+    const auto res = bux::tryQuery(*conn, "select k,v from t", bux::MYSQL_STORE_RESULT);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(mysql_num_rows(*res), 2u);
+}
+
+TEST(MySQL, TryQueryReturnsErrors)
+{
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    const auto conn = mysql.tryMysql();
+    ASSERT_TRUE(conn);
+
+    bux::setFakeReply({.m_errno = 1213, .m_error = "Deadlock"});
+    const auto rows = bux::tryQueryRows(*conn, "select k from t for update");
+    ASSERT_FALSE(rows);
+    EXPECT_EQ(rows.error().m_errno, 1213u);
+    EXPECT_EQ(rows.error().m_kind, bux::MYERR_RETRYABLE);
+    EXPECT_FALSE(bux::tryQueryString(*conn, "select k from t for update"));
+
+    bux::setFakeReply({.m_fields = {"v"}, .m_rows = {{std::string(100, 'x')}}});
+    bux::C_MyMemoryCap cap{10};
+    const auto res = bux::tryQuery(*conn, "select v from t", bux::MYSQL_STORE_RESULT);
+    ASSERT_FALSE(res);
+    EXPECT_EQ(res.error().m_kind, bux::MYERR_FATAL);
+    EXPECT_FALSE(bux::tryQueryRows(*conn, "select v from t"));
+}
+
+TEST(MySQL, LockTablesAgainAfterReconnect)
+{
+    size_t locks = 0;
+    bux::setFakeReplier([&](std::string_view sql) -> const bux::C_FakeReply& {
+        static const bux::C_FakeReply none;
+        if (sql.starts_with("lock tables"))
+            ++locks;
+        return none;
+    });
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_LockTablesTillEnd lock{mysql};
+    lock.addRead("t");
+    lock.lock();
+    lock.lock();
+    EXPECT_EQ(locks, 1u);
+
+    mysql.disconnect();
+    lock.lock();
+    EXPECT_EQ(locks, 2u);
+    bux::setFakeReply({});
+}
+
+TEST(MySQL, LockTimeoutNotRetried)
+{
+    size_t locks = 0;
+    bux::setFakeReplier([&](std::string_view sql) -> const bux::C_FakeReply& {
+        static const bux::C_FakeReply none, timeout{.m_errno = 1205, .m_error = "Lock wait timeout exceeded"};
+        if (!sql.starts_with("lock tables"))
+            return none;
+
+        ++locks;
+        return timeout;
+    });
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_LockTablesTillEnd lock{mysql};
+    lock.addWrite("t");
+    EXPECT_ANY_THROW(lock.lock());
+    EXPECT_EQ(locks, 1u);
+    bux::setFakeReply({});
+}
+
+TEST(MySQL, StoredResultCountedWithoutCap)
+{
+    bux::setFakeReply({.m_fields = {"v"}, .m_rows = {{std::string(100, 'x')}, {"y"}}});
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    const auto before = mysql.memoryHeld();
+    {
+        const auto res = bux::query(mysql, "select v from t", bux::MYSQL_STORE_RESULT);
+        EXPECT_GE(res.bytes(), 200u);
+        EXPECT_EQ(mysql.memoryHeld(), before + static_cast<long long>(res.bytes()));
+    }
+    EXPECT_EQ(mysql.memoryHeld(), before);
+}
+
+TEST(MySQL, TryStmtReturnsErrors)
+{
+    bux::setFakeReply({.m_fields = {"v"}, .m_rows = {{std::string(100, 'x')}, {std::nullopt}}});
+    bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+    bux::C_MySqlStmt stmt{mysql.mysql()};
+    ASSERT_TRUE(stmt.tryPrepare("select v from t where k=?"));
+    int k = 1;
+    ASSERT_TRUE(stmt.tryBindParams([&](MYSQL_BIND *barr){ bux::bindInt(barr[0], k); }));
+
+    const auto rows = stmt.tryExecFetchRows();
+    ASSERT_TRUE(rows);
+    ASSERT_EQ(rows->m_rows.size(), 2u);
+    EXPECT_EQ(rows->m_rows[0][0]->size(), 100u);
+    EXPECT_FALSE(rows->m_rows[1][0]);
+
+    bux::C_MyMemoryCap cap{10};
+    const auto capped = stmt.tryExecFetchRows();
+    ASSERT_FALSE(capped);
+    EXPECT_EQ(capped.error().m_kind, bux::MYERR_FATAL);
+}
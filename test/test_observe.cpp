@@ -0,0 +1,86 @@
+﻿#include "fake_connector.h"
+#include <bux/oo_mariadb.h> // bux::C_MySQL, bux::C_MySqlStmt
+#include <bux/oo_mariadb_observe.h> // bux::C_MyHistogram, bux::I_MyObserver, bux::addObserver()
+#include <gtest/gtest.h>    // TEST(), EXPECT_EQ()
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector<>
+
+namespace {
+
+//
+//      In-Module Types
+//
+struct C_ExecParams: bux::I_MyObserver
+{
+    std::vector<int> m_values; // First parameter of each MYOP_EXEC of m_sql, or -1 if it is not an int
+    const std::string_view m_sql;
+
+    explicit C_ExecParams(std::string_view sql): m_sql(sql) {}
+    void onOp(const bux::C_MyOpEvent &ev) noexcept override
+    {
+        if (ev.m_op == bux::MYOP_EXEC && ev.m_sql == m_sql)
+            m_values.emplace_back(ev.m_paramCount && ev.m_params[0].buffer_type == MYSQL_TYPE_LONG?
+                *static_cast<const int*>(ev.m_params[0].buffer): -1);
+    }
+};
+
+} // namespace
+
+TEST(Histogram, Empty)
+{
+    const bux::C_MyHistogram h;
+    EXPECT_EQ(h.count(), 0u);
+    EXPECT_EQ(h.percentile(50), 0u);
+}
+
+TEST(Histogram, PercentilesWithinRelativeError)
+{
+    bux::C_MyHistogram h;
+    for (uint64_t i = 1; i <= 1000; ++i)
+        h.record(i * 1000);
+
+    EXPECT_EQ(h.count(), 1000u);
+    EXPECT_EQ(h.sum(), 500500000u);
+    EXPECT_EQ(h.max(), 1000000u);
+    for (auto [p, exact]: {std::pair{50., 500000.}, {90., 900000.}, {99., 990000.}})
+        EXPECT_NEAR(double(h.percentile(p)), exact, exact / 16) << p << "-th percentile";
+
+    EXPECT_LE(h.percentile(100), h.max());
+    h.reset();
+    EXPECT_EQ(h.count(), 0u);
+    EXPECT_EQ(h.max(), 0u);
+}
+
+TEST(Histogram, SmallValuesAreExact)
+{
+    bux::C_MyHistogram h;
+    for (uint64_t i = 0; i < 10; ++i)
+        h.record(i);
+
+    EXPECT_EQ(h.percentile(50), 4u);
+}
+
+#ifndef BUX_MY_NO_OBSERVERS
+TEST(Observe, ExecReportsBoundParams)
+{
+    bux::setFakeReply({.m_fields = {"v"}, .m_rows = {{"x"}}});
+    C_ExecParams obs{"select v from kv where id=?"};
+    bux::addObserver(obs);
+    {
+        bux::C_MySQL mysql{bux::C_MyConnectArg{}};
+        bux::C_MySqlStmt stmt{mysql.mysql()};
+        stmt.prepare("select v from kv where id=?");
+        int id = 42;
+        stmt.bindParams([&](MYSQL_BIND *barr){ bux::bindInt(barr[0], id); });
+        char buf[8];
+        for (int i = 0; i < 2; ++i)
+        {
+            // Result binds must not be mistaken for the bound parameters
+            stmt.execBindResults([&](MYSQL_BIND *barr){ bux::bindStrBuffer(barr[0], buf, sizeof buf); });
+            while (stmt.nextRow());
+        }
+    }
+    bux::removeObserver(obs);
+    EXPECT_EQ(obs.m_values, (std::vector<int>{42, 42}));
+}
+#endif
@@ -0,0 +1,88 @@
+﻿#include <bux/oo_mariadb_record.h>
+#include <gtest/gtest.h>    // TEST(), EXPECT_EQ()
+#include <cstring>          // memcpy(), memset()
+#include <filesystem>       // std::filesystem::temp_directory_path()
+#include <fstream>          // std::ofstream
+#include <stdexcept>        // std::runtime_error
+
+namespace {
+
+//
+//      In-Module Functions
+//
+std::string tracePath(const char *name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+} // namespace
+
+TEST(Trace, RoundTrip)
+{
+    const auto path = tracePath("bux-mariadb-test-roundtrip.trace");
+    const std::string longSql = "select " + std::string(300, 'a') + " from t where id=?";
+    long long value = 0x123456789abcdefLL;
+    MYSQL_BIND param;
+    memset(&param, 0, sizeof param);
+    param.buffer_type = MYSQL_TYPE_LONGLONG;
+    param.buffer = &value;
+    {
+        bux::C_MyTraceRecorder rec{path};
+        bux::C_MyOpEvent ev{bux::MYOP_EXEC, longSql, nullptr, std::chrono::steady_clock::now()};
+        ev.m_elapsed = std::chrono::hours{3};   // Takes a varint of several bytes
+        ev.m_errno = 1213;
+        ev.m_params = &param;
+        ev.m_paramCount = 1;
+        rec.onOp(ev);
+        ev.m_elapsed = std::chrono::nanoseconds{5};
+        ev.m_errno = 0;
+        rec.onOp(ev);
+        rec.onOp({bux::MYOP_QUERY, "commit", nullptr, std::chrono::steady_clock::now()});
+        rec.onOp({bux::MYOP_FETCH, "ignored", nullptr, std::chrono::steady_clock::now()});
+    }
+    bux::C_MyTraceReader reader{path};
+    bux::C_MyTraceRecord r;
+    ASSERT_TRUE(reader.next(r));
+    EXPECT_EQ(r.m_op, bux::MYOP_EXEC);
+    EXPECT_EQ(r.m_elapsedNs, uint64_t(std::chrono::nanoseconds{std::chrono::hours{3}}.count()));
+    EXPECT_EQ(r.m_errno, 1213u);
+    EXPECT_EQ(*r.m_sql, longSql);
+    ASSERT_EQ(r.m_params.size(), 1u);
+    EXPECT_EQ(r.m_params[0].m_type, MYSQL_TYPE_LONGLONG);
+    EXPECT_FALSE(r.m_params[0].m_null);
+    ASSERT_EQ(r.m_params[0].m_bytes.size(), sizeof value);
+    long long readBack;
+    memcpy(&readBack, r.m_params[0].m_bytes.data(), sizeof readBack);
+    EXPECT_EQ(readBack, value);
+
+    ASSERT_TRUE(reader.next(r));
+    EXPECT_EQ(r.m_elapsedNs, 5u);
+    EXPECT_EQ(r.m_sqlId, 0u);   // Interned
+    EXPECT_EQ(*r.m_sql, longSql);
+
+    ASSERT_TRUE(reader.next(r));
+    EXPECT_EQ(r.m_op, bux::MYOP_QUERY);
+    EXPECT_EQ(r.m_sqlId, 1u);
+    EXPECT_EQ(*r.m_sql, "commit");
+    EXPECT_TRUE(r.m_params.empty());
+    EXPECT_FALSE(reader.next(r));
+    std::filesystem::remove(path);
+}
+
+TEST(Trace, CorruptLengthThrows)
+{
+    const auto path = tracePath("bux-mariadb-test-corrupt.trace");
+    {
+        std::ofstream out{path, std::ios::binary};
+        out.write("BUXMYTR1", 8);
+        out.put(char(bux::MYOP_QUERY | 0x80));
+        for (int i = 0; i < 5; ++i)
+            out.put(0);     // start, elapsed, connection id, errno and SQL id
+
+        out.write("\xff\xff\xff\xff\xff\xff\xff\x7f", 8);  // SQL length of 2^56-1
+    }
+    bux::C_MyTraceReader reader{path};
+    bux::C_MyTraceRecord r;
+    EXPECT_THROW(reader.next(r), std::runtime_error);
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,48 @@
+﻿#include <bux/oo_mariadb_sql.h>
+#include <gtest/gtest.h>    // TEST(), EXPECT_EQ()
+#include <string>           // std::string
+#include <vector>           // std::vector<>
+
+TEST(Sql, TablesOfReads)
+{
+    EXPECT_EQ(bux::sqlTables("select a from t1 join db2.t2 on x where y in (select z from `t 3`)"),
+        (std::vector<std::string>{"t1", "t2", "t 3"}));
+}
+
+TEST(Sql, TablesOfWrites)
+{
+    EXPECT_EQ(bux::sqlTables("insert into t(a) values(1)"), std::vector<std::string>{"t"});
+    EXPECT_EQ(bux::sqlTables("update t set a=1"), std::vector<std::string>{"t"});
+    EXPECT_EQ(bux::sqlTables("delete from t where 1"), std::vector<std::string>{"t"});
+}
+
+TEST(Sql, FingerprintReplacesLiterals)
+{
+    EXPECT_EQ(bux::fingerprintSql("SELECT  a FROM t WHERE id = 42 AND s='x''y'"), "select a from t where id = ? and s = ?");
+    EXPECT_EQ(bux::fingerprintSql("select a from t where id in (1,2,3)"), bux::fingerprintSql("select a from t where id in (4, 5)"));
+}
+
+TEST(Sql, NormalizeKeepsLiterals)
+{
+    EXPECT_EQ(bux::normalizeSql("  select   a\n from t where s='x  y' -- note\n"), "select a from t where s='x  y'");
+    EXPECT_NE(bux::normalizeSql("select a from t where id=1"), bux::normalizeSql("select a from t where id=2"));
+}
+
+TEST(Sql, SubstitutePlaceholders)
+{
+    EXPECT_EQ(bux::substituteSqlPlaceholders("select ? , '?' from t where a=? and b=?", {"1", "'x'"}),
+        "select 1 , '?' from t where a='x' and b=?");
+    EXPECT_EQ(bux::countSqlPlaceholders("select ?, '?', `?` -- ?\n from t where a=?"), 2u);
+}
+
+TEST(Sql, KindsOfStatements)
+{
+    EXPECT_TRUE(bux::isCallSql(" CALL p()"));
+    EXPECT_TRUE(bux::isCallSql("select 1;call p()"));
+    EXPECT_FALSE(bux::isCallSql("select call_count from t"));
+    EXPECT_TRUE(bux::isCommitSql("commit"));
+    EXPECT_FALSE(bux::isCommitSql("commit_x"));
+    EXPECT_TRUE(bux::isWriteSql("call p()"));
+    EXPECT_TRUE(bux::isWriteSql("update t set a=1"));
+    EXPECT_FALSE(bux::isWriteSql("select a from t"));
+}
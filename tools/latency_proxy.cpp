@@ -0,0 +1,239 @@
+﻿#include "latency_proxy.h"
+#include <bux/XException.h> // RUNTIME_ERROR()
+#include <algorithm>        // std::max()
+#include <arpa/inet.h>      // htonl(), htons(), ntohs()
+#include <cerrno>           // errno
+#include <netdb.h>          // getaddrinfo()
+#include <netinet/in.h>     // sockaddr_in
+#include <netinet/tcp.h>    // TCP_NODELAY
+#include <string>           // std::to_string()
+#include <sys/socket.h>     // socket(), accept(), recv(), send(), shutdown()
+#include <unistd.h>         // close()
+
+namespace {
+
+//
+//      In-Module Constants
+//
+constexpr size_t CHUNK_MAX = 64 * 1024;
+
+//
+//      In-Module Functions
+//
+void setNoDelay(int fd) noexcept
+{
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+}
+
+} // namespace
+
+namespace bux {
+
+//
+//      Implement Classes
+//
+/*! \param [in] upstreamHost Host of the proxied server
+    \param [in] upstreamPort Port of the proxied server
+    \param [in] listenPort Port to listen on 127.0.0.1, or 0 for an ephemeral one as told by port()
+    \param [in] opts RTT and bandwidth to simulate
+*/
+C_LatencyProxy::C_LatencyProxy(std::string upstreamHost, unsigned upstreamPort, unsigned listenPort, const C_Options &opts):
+    m_upstreamHost(std::move(upstreamHost)),
+    m_upstreamPort(upstreamPort),
+    m_opts(opts)
+{
+    m_listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listener < 0)
+        RUNTIME_ERROR("socket() fails with errno {}", errno);
+
+    const int on = 1;
+    setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(listenPort));
+    socklen_t len = sizeof addr;
+    if (bind(m_listener, reinterpret_cast<sockaddr*>(&addr), sizeof addr) ||
+        listen(m_listener, SOMAXCONN) ||
+        getsockname(m_listener, reinterpret_cast<sockaddr*>(&addr), &len))
+    {
+        const auto err = errno;
+        close(m_listener);
+        RUNTIME_ERROR("Fail to listen on port {} with errno {}", listenPort, err);
+    }
+    m_port = ntohs(addr.sin_port);
+    m_acceptor = std::jthread([this]{ acceptLinks(); });
+}
+
+C_LatencyProxy::~C_LatencyProxy()
+{
+    // Wake up accept()
+    shutdown(m_listener, SHUT_RDWR);
+    m_acceptor.join();
+    close(m_listener);
+    m_links.clear();
+}
+
+void C_LatencyProxy::acceptLinks()
+{
+    for (;;)
+    {
+        const int client = accept(m_listener, nullptr, nullptr);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            // Shut down
+            return;
+        }
+        int server;
+        try
+        {
+            server = connectUpstream();
+        }
+        catch (...)
+        {
+            close(client);
+            continue;
+        }
+        setNoDelay(client);
+        setNoDelay(server);
+
+        std::lock_guard _{m_linkLock};
+        std::erase_if(m_links, [](auto &i){ return i->m_exited.load() == 4; });
+
+        auto &link = *m_links.emplace_back(std::make_unique<C_Link>(client, server));
+        link.m_threads[0] = std::jthread([&link]{ readLoop(link, link.m_client, link.m_up); });
+        link.m_threads[1] = std::jthread([this,&link]{ writeLoop(link, link.m_server, link.m_up); });
+        link.m_threads[2] = std::jthread([&link]{ readLoop(link, link.m_server, link.m_down); });
+        link.m_threads[3] = std::jthread([this,&link]{ writeLoop(link, link.m_client, link.m_down); });
+    }
+}
+
+int C_LatencyProxy::connectUpstream() const
+{
+    addrinfo hints{}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (const int err = getaddrinfo(m_upstreamHost.c_str(), std::to_string(m_upstreamPort).c_str(), &hints, &res))
+        RUNTIME_ERROR("Fail to resolve {}: {}", m_upstreamHost, gai_strerror(err));
+
+    int ret = -1;
+    for (auto i = res; i; i = i->ai_next)
+    {
+        ret = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
+        if (ret < 0)
+            continue;
+        if (!connect(ret, i->ai_addr, i->ai_addrlen))
+            break;
+
+        close(ret);
+        ret = -1;
+    }
+    freeaddrinfo(res);
+    if (ret < 0)
+        RUNTIME_ERROR("Fail to connect to {}:{}", m_upstreamHost, m_upstreamPort);
+
+    return ret;
+}
+
+void C_LatencyProxy::readLoop(C_Link &link, int from, C_Pipe &pipe)
+{
+    for (;;)
+    {
+        std::vector<char> buf(CHUNK_MAX);
+        const auto n = recv(from, buf.data(), buf.size(), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        const auto now = std::chrono::steady_clock::now();
+        if (n <= 0)
+        {
+            pipe.push({now, {}});
+            break;
+        }
+        buf.resize(static_cast<size_t>(n));
+        pipe.push({now, std::move(buf)});
+    }
+    ++link.m_exited;
+}
+
+void C_LatencyProxy::writeLoop(C_Link &link, int to, C_Pipe &pipe) const
+/*! \brief Send each chunk after it is fully serialized at C_Options::m_bytesPerSec and then delayed by half the RTT
+*/
+{
+    const auto delay = m_opts.m_rtt / 2;
+    std::chrono::steady_clock::time_point free{};   // When the simulated wire is done with the previous chunk
+    for (;;)
+    {
+        auto chunk = pipe.pop();
+        if (chunk.m_data.empty())
+        {
+            shutdown(to, SHUT_WR);
+            break;
+        }
+        free = std::max(free, chunk.m_arrived);
+        if (m_opts.m_bytesPerSec)
+            free += std::chrono::nanoseconds(chunk.m_data.size() * 1000'000'000 / m_opts.m_bytesPerSec);
+
+        std::this_thread::sleep_until(free + delay);
+        size_t sent = 0;
+        while (sent < chunk.m_data.size())
+        {
+            const auto n = send(to, chunk.m_data.data() + sent, chunk.m_data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                // Peer is gone
+                link.abort();
+                ++link.m_exited;
+                return;
+            }
+            sent += static_cast<size_t>(n);
+        }
+    }
+    ++link.m_exited;
+}
+
+C_LatencyProxy::C_Chunk C_LatencyProxy::C_Pipe::pop()
+{
+    std::unique_lock lk{m_lock};
+    m_cv.wait(lk, [this]{ return !m_chunks.empty(); });
+    auto ret = std::move(m_chunks.front());
+    m_chunks.pop_front();
+    return ret;
+}
+
+void C_LatencyProxy::C_Pipe::push(C_Chunk &&chunk)
+{
+    {
+        std::lock_guard _{m_lock};
+        m_chunks.emplace_back(std::move(chunk));
+    }
+    m_cv.notify_one();
+}
+
+C_LatencyProxy::C_Link::~C_Link()
+{
+    abort();
+    for (auto &i: m_threads)
+        if (i.joinable())
+            i.join();
+
+    close(m_client);
+    close(m_server);
+}
+
+void C_LatencyProxy::C_Link::abort() const noexcept
+/*! \brief Make both readers see EOF, which in turn ends both writers
+*/
+{
+    shutdown(m_client, SHUT_RDWR);
+    shutdown(m_server, SHUT_RDWR);
+}
+
+} // namespace bux
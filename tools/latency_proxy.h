@@ -0,0 +1,99 @@
+﻿#pragma once
+
+/*! \file
+    \brief Local TCP proxy injecting network latency and bandwidth limits in front of mariadbd
+*/
+
+#include <atomic>           // std::atomic<>
+#include <chrono>           // std::chrono::microseconds, std::chrono::steady_clock
+#include <condition_variable>   // std::condition_variable_any
+#include <cstdint>          // uint64_t
+#include <deque>            // std::deque<>
+#include <list>             // std::list<>
+#include <memory>           // std::unique_ptr<>
+#include <mutex>            // std::mutex
+#include <string>           // std::string
+#include <thread>           // std::jthread
+#include <vector>           // std::vector<>
+
+namespace bux {
+
+//
+//      Types
+//
+class C_LatencyProxy
+/*! \brief Accept connections on 127.0.0.1 and relay each to the upstream server, delaying every chunk of bytes
+    by half the RTT in either direction, and optionally serializing them at a limited bandwidth.
+
+    Chunks are what a single <tt>recv()</tt> gets, usually one or a few protocol packets; their order is kept.
+*/
+{
+public:
+
+    // Types
+    struct C_Options
+    {
+        std::chrono::microseconds   m_rtt{};
+        uint64_t                    m_bytesPerSec{};    ///< Zero for unlimited
+    };
+
+    // Nonvirtuals
+    C_LatencyProxy(std::string upstreamHost, unsigned upstreamPort, unsigned listenPort, const C_Options &opts);
+    ~C_LatencyProxy();
+    C_LatencyProxy(const C_LatencyProxy&) = delete;
+    C_LatencyProxy &operator=(const C_LatencyProxy&) = delete;
+    auto port() const { return m_port; }
+
+private:
+
+    // Types
+    struct C_Chunk
+    {
+        std::chrono::steady_clock::time_point   m_arrived;
+        std::vector<char>                       m_data;     // Empty for EOF
+    };
+    class C_Pipe
+    {
+    public:
+
+        // Nonvirtuals
+        C_Chunk pop();
+        void push(C_Chunk &&chunk);
+
+    private:
+
+        // Data
+        std::mutex                  m_lock;
+        std::condition_variable_any m_cv;
+        std::deque<C_Chunk>         m_chunks;
+    };
+    struct C_Link
+    {
+        const int       m_client, m_server;
+        C_Pipe          m_up, m_down;
+        std::atomic<int> m_exited{};   // Number of threads done
+        std::jthread    m_threads[4];
+
+        C_Link(int client, int server) noexcept: m_client(client), m_server(server) {}
+        ~C_Link();
+        void abort() const noexcept;
+    };
+
+    // Data
+    const std::string           m_upstreamHost;
+    const unsigned              m_upstreamPort;
+    const C_Options             m_opts;
+    int                         m_listener{-1};
+    unsigned                    m_port{};
+    std::mutex                  m_linkLock;     // Guards m_links
+    std::list<std::unique_ptr<C_Link>> m_links;
+    std::jthread                m_acceptor;
+
+    // Nonvirtuals
+    void acceptLinks();
+    int connectUpstream() const;
+    static void readLoop(C_Link &link, int from, C_Pipe &pipe);
+    void writeLoop(C_Link &link, int to, C_Pipe &pipe) const;
+};
+
+} // namespace bux
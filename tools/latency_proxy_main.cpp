@@ -0,0 +1,62 @@
+﻿#include "latency_proxy.h"
+#include <csignal>          // sigwait(), SIGINT, SIGTERM
+#include <cstdlib>          // strtod(), strtoul()
+#include <cstring>          // strcmp()
+#include <iostream>         // std::cerr, std::cout
+#include <pthread.h>        // pthread_sigmask()
+#include <string>           // std::string
+
+namespace {
+
+//
+//      In-Module Functions
+//
+int usage(const char *prog)
+{
+    std::cerr <<"Usage: " <<prog <<" <upstream-host>:<port> <listen-port> [--rtt-ms <ms>] [--kbps <kilobytes-per-sec>]\n"
+                "Relay connections on 127.0.0.1:<listen-port> to the upstream server with injected latency till SIGINT.\n";
+    return 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+        return usage(argv[0]);
+
+    const std::string upstream = argv[1];
+    const auto colon = upstream.rfind(':');
+    if (colon == std::string::npos)
+        return usage(argv[0]);
+
+    bux::C_LatencyProxy::C_Options opts;
+    for (int i = 3; i < argc; ++i)
+        if (!strcmp(argv[i], "--rtt-ms") && i + 1 < argc)
+            opts.m_rtt = std::chrono::microseconds(static_cast<long long>(strtod(argv[++i], nullptr) * 1000));
+        else if (!strcmp(argv[i], "--kbps") && i + 1 < argc)
+            opts.m_bytesPerSec = strtoul(argv[++i], nullptr, 10) * 1024;
+        else
+            return usage(argv[0]);
+
+    // Block signals before any thread is spawned so that only sigwait() gets them
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+    try
+    {
+        bux::C_LatencyProxy proxy{upstream.substr(0, colon),
+            static_cast<unsigned>(strtoul(upstream.c_str() + colon + 1, nullptr, 10)),
+            static_cast<unsigned>(strtoul(argv[2], nullptr, 10)), opts};
+        std::cout <<"Listening on 127.0.0.1:" <<proxy.port() <<" with RTT " <<opts.m_rtt.count() <<"us" <<std::endl;
+        int sig;
+        sigwait(&sigs, &sig);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr <<e.what() <<'\n';
+        return 1;
+    }
+}
@@ -0,0 +1,554 @@
+﻿#include <bux/oo_mariadb.h> // bux::C_MySQL, bux::C_MySqlStmt
+#include <bux/oo_mariadb_observe.h> // bux::C_MyHistogram
+#include <bux/XException.h> // RUNTIME_ERROR()
+#include <algorithm>        // std::fill(), std::find()
+#include <atomic>           // std::atomic<>
+#include <chrono>           // std::chrono::steady_clock
+#include <condition_variable>   // std::condition_variable
+#include <cstdio>           // printf()
+#include <cstdlib>          // strtod(), strtoul()
+#include <cstring>          // strcmp()
+#include <getopt.h>         // getopt_long()
+#include <iostream>         // std::cerr
+#include <memory>           // std::unique_ptr<>
+#include <mutex>            // std::mutex
+#include <optional>         // std::optional<>
+#include <random>           // std::mt19937_64, std::uniform_int_distribution<>
+#include <string>           // std::string, std::to_string()
+#include <string_view>      // std::string_view
+#include <thread>           // std::jthread, std::this_thread::sleep_until()
+#include <vector>           // std::vector<>
+
+namespace {
+
+//
+//      In-Module Types
+//
+using C_Clock = std::chrono::steady_clock;
+
+enum E_Op
+{
+    OP_POINT,
+    OP_RANGE,
+    OP_INSERT,
+    OP_UPDATE,
+    OP_BLOB,
+    OP_COUNT
+};
+
+struct C_Config
+{
+    bux::C_MyConnectArg m_connArg{"127.0.0.1", "root", {}, "bux_load", "utf8mb4", {}};
+    unsigned            m_threads{8};
+    unsigned            m_pool{};           // Zero for a connection per thread
+    unsigned            m_mix[OP_COUNT]{70, 10, 10, 5, 5};
+    double              m_rate{};           // Total ops per second, zero for closed loop
+    double              m_warmup{10}, m_duration{60}, m_interval{1};   // in seconds
+    unsigned            m_rows{100000};
+    unsigned            m_rangeSize{100};
+    unsigned            m_blobBytes{65536};
+    bool                m_prepare{};
+};
+
+class C_Session
+/// \brief Connection with lazily prepared statements, one per E_Op
+{
+public:
+
+    // Nonvirtuals
+    explicit C_Session(const bux::C_MyConnectArg &arg): m_mysql(arg) {}
+    void reset() noexcept;
+    bux::C_MySqlStmt &stmt(E_Op op);
+
+private:
+
+    // Data
+    bux::C_MySQL                        m_mysql;
+    std::optional<bux::C_MySqlStmt>     m_stmts[OP_COUNT];
+};
+
+class C_SessionPool
+{
+public:
+
+    // Nonvirtuals
+    C_SessionPool(const bux::C_MyConnectArg &arg, size_t n);
+    C_Session &acquire();
+    void release(C_Session &session);
+
+private:
+
+    // Data
+    std::mutex                              m_lock;
+    std::condition_variable                 m_cv;
+    std::vector<C_Session>                  m_all;      // Never reallocated after construction
+    std::vector<C_Session*>                 m_free;
+};
+
+class C_LoadRun
+/*! \brief Run the mix across threads and report throughput and latency percentiles every interval.
+
+    In the fixed-rate mode each operation has an intended start time and its latency counts from then,
+    so that a stall of the server is not hidden by the stalled threads issuing fewer operations
+    (coordinated omission).
+*/
+{
+public:
+
+    // Nonvirtuals
+    explicit C_LoadRun(const C_Config &cfg);
+    void run();
+
+private:
+
+    // Types
+    struct C_Interval
+    {
+        bux::C_MyHistogram      m_latency;
+        std::atomic<uint64_t>   m_errors{};
+        std::atomic<unsigned>   m_recorders{};  // Workers in the middle of recording, waited by report()
+    };
+
+    // Data
+    const C_Config                  m_cfg;
+    const unsigned                  m_mixTotal;
+    std::unique_ptr<C_SessionPool>  m_pool;
+    C_Clock::time_point             m_start, m_measureStart, m_end;
+    std::atomic<bool>               m_stop{};
+    bux::C_MyHistogram              m_latency[OP_COUNT];
+    C_Interval                      m_interval[2];
+    std::atomic<unsigned>           m_epoch{};  // Parity selects m_interval[] being recorded
+    std::atomic<uint64_t>           m_errors[OP_COUNT]{};
+
+    // Nonvirtuals
+    C_Interval &enterInterval() noexcept;
+    E_Op pick(std::mt19937_64 &rng) const;
+    void report();
+    void runOp(C_Session &session, E_Op op, std::mt19937_64 &rng) const;
+    void work(unsigned index);
+};
+
+//
+//      In-Module Constants
+//
+constexpr const char *OP_NAMES[OP_COUNT] = {"point", "range", "insert", "update", "blob"};
+constexpr const char *OP_SQLS[OP_COUNT] = {
+    "select c,pad from sbtest where id=?",
+    "select c from sbtest where id between ? and ?",
+    "insert into sbtest(k,c,pad) values(?,?,?)",
+    "update sbtest set k=k+1 where id=?",
+    "select b from blobs where id=?"
+};
+constexpr unsigned BLOB_ROWS = 16;
+
+//
+//      In-Module Functions
+//
+double ms(uint64_t ns) noexcept
+{
+    return double(ns) / 1e6;
+}
+
+void prepareTables(const C_Config &cfg)
+{
+    auto arg = cfg.m_connArg;
+    arg.m_db.clear();
+    bux::C_MySQL mysql{arg};
+    bux::query(mysql, "create database if not exists " + cfg.m_connArg.m_db);
+    bux::useDatabase(mysql, cfg.m_connArg.m_db);
+    bux::query(mysql, "drop table if exists sbtest, blobs");
+    bux::query(mysql, "create table sbtest(id int unsigned auto_increment primary key, k int unsigned not null,"
+        " c char(120) not null, pad char(60) not null, key(k))");
+    const auto rows = std::to_string(cfg.m_rows);
+    bux::query(mysql, "insert into sbtest select seq, floor(1+rand()*" + rows + "), sha2(seq,512), md5(seq) from seq_1_to_" + rows);
+    bux::query(mysql, "create table blobs(id int unsigned primary key, b longblob not null)");
+    bux::query(mysql, "insert into blobs select seq, repeat(char(64+seq), " + std::to_string(cfg.m_blobBytes) +
+        ") from seq_1_to_" + std::to_string(BLOB_ROWS));
+}
+
+void parseMix(const char *s, unsigned (&mix)[OP_COUNT])
+/*! \brief Parse \a s like <tt>point=70,range=10,insert=10,update=5,blob=5</tt>; ops not mentioned are weighted zero
+*/
+{
+    std::fill(std::begin(mix), std::end(mix), 0);
+    for (std::string_view rest = s; !rest.empty();)
+    {
+        const auto comma = rest.find(',');
+        const auto item = rest.substr(0, comma);
+        rest = comma == rest.npos? std::string_view{}: rest.substr(comma + 1);
+        const auto eq = item.find('=');
+        const auto name = item.substr(0, eq);
+        const auto found = std::find(std::begin(OP_NAMES), std::end(OP_NAMES), name);
+        if (eq == item.npos || found == std::end(OP_NAMES))
+            RUNTIME_ERROR("Bad mix item \"{}\"", item);
+
+        mix[found - std::begin(OP_NAMES)] = static_cast<unsigned>(std::stoul(std::string{item.substr(eq + 1)}));
+    }
+}
+
+int usage(const char *prog)
+{
+    std::cerr <<"Usage: " <<prog <<" [options]\n"
+        "  --host <host>          Default 127.0.0.1\n"
+        "  --port <port>\n"
+        "  --user <user>          Default root\n"
+        "  --password <password>\n"
+        "  --db <db>              Default bux_load\n"
+        "  --prepare              (Re)create and populate the tables first\n"
+        "  --rows <n>             Rows of sbtest to populate, default 100000\n"
+        "  --blob-bytes <n>       Size of each blob to populate, default 65536\n"
+        "  --threads <n>          Default 8\n"
+        "  --pool <n>             Share n connections among threads, default 0 for a connection per thread\n"
+        "  --mix <op=weight,...>  Ops are point, range, insert, update, blob. Default point=70,range=10,insert=10,update=5,blob=5\n"
+        "  --range-size <n>       Rows per range scan, default 100\n"
+        "  --rate <ops/s>         Fixed total rate with latency counted from intended start, default 0 for closed loop\n"
+        "  --warmup <s>           Default 10\n"
+        "  --duration <s>         Measured period after warmup, default 60\n"
+        "  --interval <s>         Reporting interval, default 1\n";
+    return 1;
+}
+
+//
+//      Implement Classes
+//
+void C_Session::reset() noexcept
+{
+    for (auto &i: m_stmts)
+        i.reset();
+}
+
+bux::C_MySqlStmt &C_Session::stmt(E_Op op)
+{
+    auto &ret = m_stmts[op];
+    if (!ret)
+    {
+        // Reconnect if needed
+        ret.emplace(m_mysql.mysql());
+        ret->prepare(OP_SQLS[op]);
+    }
+    return *ret;
+}
+
+C_SessionPool::C_SessionPool(const bux::C_MyConnectArg &arg, size_t n)
+{
+    m_all.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        m_free.emplace_back(&m_all.emplace_back(arg));
+}
+
+C_Session &C_SessionPool::acquire()
+{
+    std::unique_lock lk{m_lock};
+    m_cv.wait(lk, [this]{ return !m_free.empty(); });
+    const auto ret = m_free.back();
+    m_free.pop_back();
+    return *ret;
+}
+
+void C_SessionPool::release(C_Session &session)
+{
+    {
+        std::lock_guard _{m_lock};
+        m_free.emplace_back(&session);
+    }
+    m_cv.notify_one();
+}
+
+C_LoadRun::C_LoadRun(const C_Config &cfg):
+    m_cfg(cfg),
+    m_mixTotal([&]{
+        unsigned ret = 0;
+        for (auto i: cfg.m_mix)
+            ret += i;
+        return ret;
+    }())
+{
+    if (!m_mixTotal)
+        RUNTIME_ERROR("Empty mix");
+
+    if (cfg.m_pool)
+        m_pool = std::make_unique<C_SessionPool>(cfg.m_connArg, cfg.m_pool);
+}
+
+E_Op C_LoadRun::pick(std::mt19937_64 &rng) const
+{
+    auto r = std::uniform_int_distribution<unsigned>{0, m_mixTotal - 1}(rng);
+    for (int i = 0; i < OP_COUNT; ++i)
+    {
+        if (r < m_cfg.m_mix[i])
+            return static_cast<E_Op>(i);
+
+        r -= m_cfg.m_mix[i];
+    }
+    return OP_POINT;
+}
+
+C_LoadRun::C_Interval &C_LoadRun::enterInterval() noexcept
+/*! \brief Count the caller in as a recorder of the current interval, to be counted out by decrementing
+    C_Interval::m_recorders.
+
+    The epoch is read again after counting in, so that report(), which flips the epoch before waiting for
+    recorders, never misses one still recording into the interval it reads.
+*/
+{
+    for (;;)
+    {
+        const auto epoch = m_epoch.load();
+        auto &ret = m_interval[epoch & 1];
+        ++ret.m_recorders;
+        if (m_epoch.load() == epoch)
+            return ret;
+
+        --ret.m_recorders;
+    }
+}
+
+void C_LoadRun::report()
+{
+    printf("#sec\tops/s\terr/s\tp50_ms\tp90_ms\tp99_ms\tp99.9_ms\tmax_ms\n");
+    const auto interval = std::chrono::duration_cast<C_Clock::duration>(std::chrono::duration<double>(m_cfg.m_interval));
+    for (auto t = m_measureStart + interval; t <= m_end; t += interval)
+    {
+        std::this_thread::sleep_until(t);
+        auto &cur = m_interval[m_epoch.fetch_add(1) & 1];
+        while (cur.m_recorders.load())
+            std::this_thread::yield();
+
+        const auto &h = cur.m_latency;
+        const auto errors = cur.m_errors.exchange(0);
+        printf("%.1f\t%.0f\t%.0f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n",
+            std::chrono::duration<double>(t - m_measureStart).count(),
+            double(h.count()) / m_cfg.m_interval, double(errors) / m_cfg.m_interval,
+            ms(h.percentile(50)), ms(h.percentile(90)), ms(h.percentile(99)), ms(h.percentile(99.9)), ms(h.max()));
+        fflush(stdout);
+        cur.m_latency.reset();
+    }
+    m_stop = true;
+}
+
+void C_LoadRun::run()
+{
+    m_start = C_Clock::now();
+    m_measureStart = m_start + std::chrono::duration_cast<C_Clock::duration>(std::chrono::duration<double>(m_cfg.m_warmup));
+    m_end = m_measureStart + std::chrono::duration_cast<C_Clock::duration>(std::chrono::duration<double>(m_cfg.m_duration));
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned i = 0; i < m_cfg.m_threads; ++i)
+            workers.emplace_back([this,i]{ work(i); });
+
+        report();
+    }
+    printf("\n#op\tcount\terrors\tops/s\tp50_ms\tp90_ms\tp99_ms\tp99.9_ms\tmax_ms\n");
+    for (int i = 0; i < OP_COUNT; ++i)
+    {
+        const auto &h = m_latency[i];
+        printf("%s\t%lu\t%lu\t%.0f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n", OP_NAMES[i],
+            static_cast<unsigned long>(h.count()), static_cast<unsigned long>(m_errors[i].load()),
+            double(h.count()) / m_cfg.m_duration,
+            ms(h.percentile(50)), ms(h.percentile(90)), ms(h.percentile(99)), ms(h.percentile(99.9)), ms(h.max()));
+    }
+}
+
+void C_LoadRun::runOp(C_Session &session, E_Op op, std::mt19937_64 &rng) const
+{
+    auto &stmt = session.stmt(op);
+    unsigned id = std::uniform_int_distribution<unsigned>{1, m_cfg.m_rows}(rng);
+    switch (op)
+    {
+    case OP_POINT:
+    {
+        char c[121], pad[61];
+        stmt.bindParams([&](MYSQL_BIND *barr){
+            bux::bindInt(barr[0], id);
+        });
+        stmt.execBindResults([&](MYSQL_BIND *barr){
+            bux::bindStrBuffer(barr[0], c, sizeof c);
+            bux::bindStrBuffer(barr[1], pad, sizeof pad);
+        });
+        while (stmt.nextRow());
+        break;
+    }
+    case OP_RANGE:
+    {
+        unsigned last = id + m_cfg.m_rangeSize - 1;
+        char c[121];
+        stmt.bindParams([&](MYSQL_BIND *barr){
+            bux::bindInt(barr[0], id);
+            bux::bindInt(barr[1], last);
+        });
+        stmt.execBindResults([&](MYSQL_BIND *barr){
+            bux::bindStrBuffer(barr[0], c, sizeof c);
+        });
+        while (stmt.nextRow());
+        break;
+    }
+    case OP_INSERT:
+    {
+        const auto c = std::to_string(rng()) + std::string(100, 'c');
+        const auto pad = std::to_string(id) + std::string(40, 'p');
+        stmt.bindParams([&](MYSQL_BIND *barr){
+            bux::bindInt(barr[0], id);
+            bux::bindStrParam(barr[1], c);
+            bux::bindStrParam(barr[2], pad);
+        });
+        stmt.exec();
+        break;
+    }
+    case OP_UPDATE:
+        stmt.bindParams([&](MYSQL_BIND *barr){
+            bux::bindInt(barr[0], id);
+        });
+        stmt.exec();
+        break;
+    case OP_BLOB:
+        id = id % BLOB_ROWS + 1;
+        stmt.bindParams([&](MYSQL_BIND *barr){
+            bux::bindInt(barr[0], id);
+        });
+        stmt.execBindResults([](MYSQL_BIND *barr){
+            bux::bindLongBlob(barr[0]);
+        });
+        if (stmt.nextRow())
+        {
+            (void)stmt.getLongBlob(0);
+            while (stmt.nextRow());
+        }
+        break;
+    default:;
+    }
+}
+
+void C_LoadRun::work(unsigned index)
+{
+    std::mt19937_64 rng{std::random_device{}() ^ index};
+    std::optional<C_Session> own;
+    try
+    {
+        if (!m_pool)
+            own.emplace(m_cfg.m_connArg);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr <<"Thread " <<index <<": " <<e.what() <<'\n';
+        return;
+    }
+    // In fixed-rate mode, threads take turns at the total rate
+    const auto period = m_cfg.m_rate > 0?
+        std::chrono::duration_cast<C_Clock::duration>(std::chrono::duration<double>(m_cfg.m_threads / m_cfg.m_rate)):
+        C_Clock::duration{};
+    auto intended = m_start + period * index / m_cfg.m_threads;
+    while (!m_stop)
+    {
+        if (period.count())
+        {
+            std::this_thread::sleep_until(intended);
+            if (m_stop)
+                break;
+        }
+        else
+            intended = C_Clock::now();
+
+        const auto op = pick(rng);
+        auto &session = own? *own: m_pool->acquire();
+        bool ok = true;
+        try
+        {
+            runOp(session, op, rng);
+        }
+        catch (const std::exception &)
+        {
+            session.reset();
+            ok = false;
+        }
+        if (!own)
+            m_pool->release(session);
+
+        const auto done = C_Clock::now();
+        if (intended >= m_measureStart && done < m_end)
+        {
+            auto &cur = enterInterval();
+            if (ok)
+            {
+                const auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(done - intended).count());
+                m_latency[op].record(ns);
+                cur.m_latency.record(ns);
+            }
+            else
+            {
+                ++m_errors[op];
+                ++cur.m_errors;
+            }
+            --cur.m_recorders;
+        }
+        intended += period;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    enum
+    {
+        OPT_HOST = 256, OPT_PORT, OPT_USER, OPT_PASSWORD, OPT_DB, OPT_PREPARE, OPT_ROWS, OPT_BLOB_BYTES,
+        OPT_THREADS, OPT_POOL, OPT_MIX, OPT_RANGE_SIZE, OPT_RATE, OPT_WARMUP, OPT_DURATION, OPT_INTERVAL
+    };
+    static const option longOpts[] = {
+        {"host",        required_argument,  nullptr, OPT_HOST},
+        {"port",        required_argument,  nullptr, OPT_PORT},
+        {"user",        required_argument,  nullptr, OPT_USER},
+        {"password",    required_argument,  nullptr, OPT_PASSWORD},
+        {"db",          required_argument,  nullptr, OPT_DB},
+        {"prepare",     no_argument,        nullptr, OPT_PREPARE},
+        {"rows",        required_argument,  nullptr, OPT_ROWS},
+        {"blob-bytes",  required_argument,  nullptr, OPT_BLOB_BYTES},
+        {"threads",     required_argument,  nullptr, OPT_THREADS},
+        {"pool",        required_argument,  nullptr, OPT_POOL},
+        {"mix",         required_argument,  nullptr, OPT_MIX},
+        {"range-size",  required_argument,  nullptr, OPT_RANGE_SIZE},
+        {"rate",        required_argument,  nullptr, OPT_RATE},
+        {"warmup",      required_argument,  nullptr, OPT_WARMUP},
+        {"duration",    required_argument,  nullptr, OPT_DURATION},
+        {"interval",    required_argument,  nullptr, OPT_INTERVAL},
+        {}
+    };
+    try
+    {
+        C_Config cfg;
+        const auto count = [](const char *s){ return static_cast<unsigned>(strtoul(s, nullptr, 10)); };
+        for (int opt; (opt = getopt_long(argc, argv, "", longOpts, nullptr)) != -1;)
+            switch (opt)
+            {
+            case OPT_HOST:          cfg.m_connArg.m_host = optarg; break;
+            case OPT_PORT:          cfg.m_connArg.m_port = count(optarg); break;
+            case OPT_USER:          cfg.m_connArg.m_user = optarg; break;
+            case OPT_PASSWORD:      cfg.m_connArg.m_password = optarg; break;
+            case OPT_DB:            cfg.m_connArg.m_db = optarg; break;
+            case OPT_PREPARE:       cfg.m_prepare = true; break;
+            case OPT_ROWS:          cfg.m_rows = count(optarg); break;
+            case OPT_BLOB_BYTES:    cfg.m_blobBytes = count(optarg); break;
+            case OPT_THREADS:       cfg.m_threads = count(optarg); break;
+            case OPT_POOL:          cfg.m_pool = count(optarg); break;
+            case OPT_MIX:           parseMix(optarg, cfg.m_mix); break;
+            case OPT_RANGE_SIZE:    cfg.m_rangeSize = count(optarg); break;
+            case OPT_RATE:          cfg.m_rate = strtod(optarg, nullptr); break;
+            case OPT_WARMUP:        cfg.m_warmup = strtod(optarg, nullptr); break;
+            case OPT_DURATION:      cfg.m_duration = strtod(optarg, nullptr); break;
+            case OPT_INTERVAL:      cfg.m_interval = strtod(optarg, nullptr); break;
+            default:
+                return usage(argv[0]);
+            }
+        if (optind < argc || !cfg.m_threads || !cfg.m_rows || !cfg.m_rangeSize || cfg.m_duration <= 0 || cfg.m_interval <= 0)
+            return usage(argv[0]);
+
+        if (cfg.m_prepare)
+            prepareTables(cfg);
+
+        C_LoadRun{cfg}.run();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr <<e.what() <<'\n';
+        return 1;
+    }
+}
@@ -0,0 +1,321 @@
+﻿#include <bux/oo_mariadb.h> // bux::C_MySQL, bux::C_MySqlStmt
+#include <bux/oo_mariadb_observe.h> // bux::C_MyHistogram
+#include <bux/oo_mariadb_record.h>  // bux::C_MyTraceReader
+#include <bux/oo_mariadb_sql.h> // bux::fingerprintSql()
+#include <algorithm>        // std::sort(), std::min()
+#include <atomic>           // std::atomic<>
+#include <chrono>           // std::chrono::steady_clock
+#include <cstdio>           // printf()
+#include <cstdlib>          // strtod(), strtoul()
+#include <getopt.h>         // getopt_long()
+#include <iostream>         // std::cerr
+#include <map>              // std::map<>
+#include <optional>         // std::optional<>
+#include <string>           // std::string
+#include <thread>           // std::jthread, std::this_thread::sleep_until()
+#include <unordered_map>    // std::unordered_map<>
+#include <vector>           // std::vector<>
+
+namespace {
+
+//
+//      In-Module Types
+//
+using C_Clock = std::chrono::steady_clock;
+
+struct C_Stats
+{
+    bux::C_MyHistogram      m_latency;
+    std::atomic<uint64_t>   m_errors{};
+};
+
+struct C_Compare
+/// \brief Original versus replayed latencies of a group of records
+{
+    C_Stats m_orig, m_replay;
+};
+
+struct C_Config
+{
+    bux::C_MyConnectArg m_connArg{"127.0.0.1", "root", {}, {}, "utf8mb4", {}};
+    double              m_speed{1};     // Replay at m_speed times the original pace, zero for as fast as possible
+};
+
+class C_Replay
+/*! \brief Replay records of each original connection on a connection of its own, in their original order
+    and at their original offsets scaled by 1 / C_Config::m_speed.
+
+    Statements are prepared once per replaying connection and SQL id; their parameters are rebound from the
+    recorded bytes. Rows are fetched and discarded outside of the measured latency, as they were when recorded.
+*/
+{
+public:
+
+    // Nonvirtuals
+    C_Replay(const C_Config &cfg, const std::string &trace);
+    void run();
+
+private:
+
+    // Types
+    typedef std::vector<bux::C_MyTraceRecord> C_Records;
+
+    // Data
+    const C_Config                      m_cfg;
+    std::map<uint64_t,C_Records>        m_conns;        // by original connection id
+    std::vector<std::string>            m_sqls;         // by SQL id
+    std::vector<C_Compare*>             m_bySql;        // by SQL id, pointing into m_byFingerprint
+    std::map<std::string,C_Compare>     m_byFingerprint;
+    C_Compare                           m_byOp[2];      // MYOP_QUERY, MYOP_EXEC
+    C_Clock::time_point                 m_start;
+
+    // Nonvirtuals
+    void replay(const C_Records &records) noexcept;
+    static bool replayExec(bux::C_MySqlStmt &stmt, const bux::C_MyTraceRecord &rec, C_Clock::duration &elapsed);
+    static bool replayQuery(MYSQL *mysql, const bux::C_MyTraceRecord &rec, C_Clock::duration &elapsed);
+    void report() const;
+};
+
+//
+//      In-Module Functions
+//
+double ms(uint64_t ns) noexcept
+{
+    return double(ns) / 1e6;
+}
+
+uint64_t nanoseconds(C_Clock::duration d) noexcept
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+void printRow(const char *name, const char *side, const C_Stats &stats)
+{
+    const auto &h = stats.m_latency;
+    printf("%s\t%s\t%lu\t%lu\t%.3f\t%.3f\t%.3f\t%.3f\n", name, side,
+        static_cast<unsigned long>(h.count()), static_cast<unsigned long>(stats.m_errors.load()),
+        ms(h.percentile(50)), ms(h.percentile(90)), ms(h.percentile(99)), ms(h.max()));
+}
+
+void printCompare(const char *name, const C_Compare &c)
+{
+    printRow(name, "orig", c.m_orig);
+    printRow(name, "replay", c.m_replay);
+}
+
+void record(C_Stats &stats, uint64_t ns, bool ok) noexcept
+{
+    if (ok)
+        stats.m_latency.record(ns);
+    else
+        ++stats.m_errors;
+}
+
+int usage(const char *prog)
+{
+    std::cerr <<"Usage: " <<prog <<" <trace-file> [options]\n"
+        "  --host <host>          Default 127.0.0.1\n"
+        "  --port <port>\n"
+        "  --user <user>          Default root\n"
+        "  --password <password>\n"
+        "  --db <db>\n"
+        "  --speed <x>            Replay at x times the original pace, default 1, 0 for as fast as possible\n";
+    return 1;
+}
+
+//
+//      Implement Classes
+//
+C_Replay::C_Replay(const C_Config &cfg, const std::string &trace): m_cfg(cfg)
+{
+    bux::C_MyTraceReader reader{trace};
+    for (bux::C_MyTraceRecord rec; reader.next(rec);)
+        m_conns[rec.m_connId].emplace_back(std::move(rec));
+
+    m_sqls.assign(reader.sqls().begin(), reader.sqls().end());
+    for (auto &i: m_sqls)
+        m_bySql.emplace_back(&m_byFingerprint[bux::fingerprintSql(i)]);
+
+    for (auto &i: m_conns)
+        for (auto &j: i.second)
+        {
+            j.m_sql = &m_sqls[j.m_sqlId];
+            const bool ok = !j.m_errno;
+            record(m_byOp[j.m_op == bux::MYOP_EXEC].m_orig, j.m_elapsedNs, ok);
+            record(m_bySql[j.m_sqlId]->m_orig, j.m_elapsedNs, ok);
+        }
+}
+
+void C_Replay::replay(const C_Records &records) noexcept
+{
+    std::optional<bux::C_MySQL> mysql;
+    std::unordered_map<uint64_t,bux::C_MySqlStmt> stmts;   // by SQL id
+    for (auto &i: records)
+    {
+        if (m_cfg.m_speed > 0)
+            std::this_thread::sleep_until(m_start + std::chrono::duration_cast<C_Clock::duration>(
+                std::chrono::duration<double,std::nano>(double(i.m_startNs) / m_cfg.m_speed)));
+
+        C_Clock::duration elapsed{};
+        bool ok = false;
+        try
+        {
+            if (!mysql)
+                mysql.emplace(m_cfg.m_connArg);
+
+            if (i.m_op == bux::MYOP_QUERY)
+                ok = replayQuery(mysql->mysql(), i, elapsed);
+            else
+            {
+                auto found = stmts.find(i.m_sqlId);
+                if (found == stmts.end())
+                {
+                    bux::C_MySqlStmt stmt{mysql->mysql()};
+                    stmt.prepare(*i.m_sql);
+                    found = stmts.try_emplace(i.m_sqlId, std::move(stmt)).first;
+                }
+                ok = replayExec(found->second, i, elapsed);
+            }
+        }
+        catch (const std::exception &)
+        {
+            // Statements may be gone with a lost connection
+            stmts.clear();
+        }
+        const auto ns = nanoseconds(elapsed);
+        record(m_byOp[i.m_op == bux::MYOP_EXEC].m_replay, ns, ok);
+        record(m_bySql[i.m_sqlId]->m_replay, ns, ok);
+    }
+}
+
+bool C_Replay::replayExec(bux::C_MySqlStmt &stmt, const bux::C_MyTraceRecord &rec, C_Clock::duration &elapsed)
+/*! \return false if the statement does not take the recorded parameters or fails
+*/
+{
+    if (mysql_stmt_param_count(stmt) != rec.m_params.size())
+        return false;
+
+    std::vector<unsigned long> lengths(rec.m_params.size());
+    std::vector<char> nulls(rec.m_params.size());
+    stmt.bindParams([&](MYSQL_BIND *barr){
+        for (size_t i = 0; i < rec.m_params.size(); ++i)
+        {
+            auto &src = rec.m_params[i];
+            auto &dst = barr[i];
+            dst.buffer_type = src.m_type;
+            dst.buffer = const_cast<char*>(src.m_bytes.data());
+            dst.buffer_length = lengths[i] = static_cast<unsigned long>(src.m_bytes.size());
+            dst.length = &lengths[i];
+            nulls[i] = src.m_null;
+            dst.is_null = reinterpret_cast<my_bool*>(&nulls[i]);
+            dst.is_unsigned = src.m_unsigned;
+        }
+    });
+    const auto start = C_Clock::now();
+    const bool ok = !stmt.execNoThrow();
+    elapsed = C_Clock::now() - start;
+    if (ok)
+        // Discard rows if any
+        stmt.clear();
+
+    return ok;
+}
+
+bool C_Replay::replayQuery(MYSQL *mysql, const bux::C_MyTraceRecord &rec, C_Clock::duration &elapsed)
+/*! \param [in] mysql Raw connection, whose ping by C_MySQL::mysql() is kept out of the timing
+    as replayExec() does with its statement
+*/
+{
+    const auto start = C_Clock::now();
+    const bool ok = bux::tryQuery(mysql, *rec.m_sql).has_value();
+    elapsed = C_Clock::now() - start;
+    if (!ok)
+        return false;
+
+    if (mysql_field_count(mysql))
+        if (const auto res = mysql_use_result(mysql))
+        {
+            while (mysql_fetch_row(res));
+            mysql_free_result(res);
+        }
+    return true;
+}
+
+void C_Replay::run()
+{
+    m_start = C_Clock::now();
+    {
+        std::vector<std::jthread> workers;
+        for (auto &i: m_conns)
+            workers.emplace_back([this,&records=i.second]{ replay(records); });
+    }
+    const auto wall = C_Clock::now() - m_start;
+    printf("# %zu connections replayed in %.3f s\n", m_conns.size(), std::chrono::duration<double>(wall).count());
+    report();
+}
+
+void C_Replay::report() const
+{
+    printf("#group\tside\tcount\terrors\tp50_ms\tp90_ms\tp99_ms\tmax_ms\n");
+    printCompare("query", m_byOp[0]);
+    printCompare("exec", m_byOp[1]);
+
+    // Top fingerprints by original total time
+    std::vector<std::pair<const std::string*,const C_Compare*>> top;
+    for (auto &i: m_byFingerprint)
+        top.emplace_back(&i.first, &i.second);
+
+    std::sort(top.begin(), top.end(), [](auto &a, auto &b){
+        return a.second->m_orig.m_latency.sum() > b.second->m_orig.m_latency.sum();
+    });
+    top.resize(std::min<size_t>(top.size(), 10));
+    for (size_t i = 0; i < top.size(); ++i)
+    {
+        printf("\n# [%zu] %s\n", i + 1, top[i].first->c_str());
+        printCompare(("#" + std::to_string(i + 1)).c_str(), *top[i].second);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    enum
+    {
+        OPT_HOST = 256, OPT_PORT, OPT_USER, OPT_PASSWORD, OPT_DB, OPT_SPEED
+    };
+    static const option longOpts[] = {
+        {"host",        required_argument,  nullptr, OPT_HOST},
+        {"port",        required_argument,  nullptr, OPT_PORT},
+        {"user",        required_argument,  nullptr, OPT_USER},
+        {"password",    required_argument,  nullptr, OPT_PASSWORD},
+        {"db",          required_argument,  nullptr, OPT_DB},
+        {"speed",       required_argument,  nullptr, OPT_SPEED},
+        {}
+    };
+    try
+    {
+        C_Config cfg;
+        for (int opt; (opt = getopt_long(argc, argv, "", longOpts, nullptr)) != -1;)
+            switch (opt)
+            {
+            case OPT_HOST:      cfg.m_connArg.m_host = optarg; break;
+            case OPT_PORT:      cfg.m_connArg.m_port = static_cast<unsigned>(strtoul(optarg, nullptr, 10)); break;
+            case OPT_USER:      cfg.m_connArg.m_user = optarg; break;
+            case OPT_PASSWORD:  cfg.m_connArg.m_password = optarg; break;
+            case OPT_DB:        cfg.m_connArg.m_db = optarg; break;
+            case OPT_SPEED:     cfg.m_speed = strtod(optarg, nullptr); break;
+            default:
+                return usage(argv[0]);
+            }
+        if (optind + 1 != argc || cfg.m_speed < 0)
+            return usage(argv[0]);
+
+        C_Replay{cfg, argv[optind]}.run();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr <<e.what() <<'\n';
+        return 1;
+    }
+}